@@ -2,6 +2,18 @@
 #define __SHARPPHYSICS_BASE_H_
 #include <cmath>
 #include <limits>
+
+// Snapshots must come out bit for bit the same on every client, so results
+// can't depend on whether the compiler fuses a*b + c into one rounding (eg.
+// when built for AVX2). Contraction is turned off for every file including
+// this one; fused multiply-adds are only ever made explicitly, by MulAdd.
+// GCC ignores these pragmas, so build with -ffp-contract=off there.
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#endif
+
 namespace SharpPhysics {
 	typedef double spf;
 	// Durations are in seconds.
@@ -11,13 +23,26 @@ namespace SharpPhysics {
 	const spf NaN = std::numeric_limits<spf>::quiet_NaN();
 	const spf Infinity = std::numeric_limits<spf>::infinity();
 	const spf PI = std::acos(-1);
+
+	// MulAdd returns a*b + c, rounded once if SHARPPHYSICS_FMA is defined and
+	// twice otherwise. Either way it's exactly defined, so builds for any
+	// instruction set agree as long as they agree on SHARPPHYSICS_FMA (without
+	// hardware FMA, std::fma is slow but still exact).
+	inline spf MulAdd(spf a, spf b, spf c) {
+#ifdef SHARPPHYSICS_FMA
+		return std::fma(a, b, c);
+#else
+		return a * b + c;
+#endif
+	}
+
 	struct Vec2d {
 		spf x, y;
 		static spf Dot(Vec2d a, Vec2d b) { 
-			return a.x * b.x + a.y * b.y; 
+			return MulAdd(a.x, b.x, a.y * b.y); 
 		}
 		spf SqrMagnitude() const { 
-			return x*x + y*y; 
+			return MulAdd(x, x, y*y); 
 		}
 		spf Magnitude() const { 
 			return std::sqrt(SqrMagnitude()); 
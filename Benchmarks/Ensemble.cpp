@@ -0,0 +1,79 @@
+// Ensemble times a shot search, ie. many variants of one table each with a
+// different cue shot, run as an Ensemble against the same variants each run
+// to rest on its own, and checks that every variant's timeline comes out
+// the same both ways. Returns non-zero if any doesn't.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "../Ensemble.h"
+#include "../Scene.h"
+
+using namespace SharpPhysics;
+
+static const int repeats = 7;
+
+// Table sets up a 20x12 table with 'balls' balls in rows, ball 0 being the
+// cue ball.
+static void Table(System *system, int balls) {
+	std::vector<CircleDef> circles;
+	std::vector<LineDef> lines;
+	for (int i = 0; i < balls; i++) {
+		circles.push_back(CircleDef{ i, nullptr, Point2d{ (i % 6) * 2.3 + 3, (i / 6) * 2.1 + 2 }, Vec2d::Zero, 0.45, 0.35, 1.0 });
+	}
+	lines.push_back(LineDef{ 100, nullptr, Point2d{ 0, 0 }, Point2d{ 20, 0 }, Infinity });
+	lines.push_back(LineDef{ 101, nullptr, Point2d{ 20, 0 }, Point2d{ 20, 12 }, Infinity });
+	lines.push_back(LineDef{ 102, nullptr, Point2d{ 20, 12 }, Point2d{ 0, 12 }, Infinity });
+	lines.push_back(LineDef{ 103, nullptr, Point2d{ 0, 12 }, Point2d{ 0, 0 }, Infinity });
+	BuildScene(system, circles, lines);
+}
+
+// Search forks 'shots' variants of a calculated table, each with its own
+// cue shot, and runs them to rest, as an Ensemble if 'together' is true
+// and otherwise one at a time. Returns the time that took in milliseconds,
+// and sets *digests to the variants' TimelineDigests.
+static double Search(int balls, int shots, bool together, std::vector<std::uint64_t> *digests) {
+	System base;
+	Table(&base, balls);
+	Ensemble ensemble(&base);
+	for (int i = 0; i < shots; i++) {
+		size_t v = ensemble.AddVariant();
+		ensemble.Variant(v)->AddImpulseEvent(0.5, 0, Vec2d{ 3 + (i % 17) * 0.7, 1.0 + (i % 5) * 0.9 });
+	}
+	auto start = std::chrono::steady_clock::now();
+	if (together) {
+		ensemble.CalculateToRest();
+	}
+	else {
+		for (size_t i = 0; i < ensemble.Size(); i++) {
+			ensemble.Variant(i)->CalculateToRest();
+		}
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	digests->clear();
+	for (size_t i = 0; i < ensemble.Size(); i++) {
+		digests->push_back(ensemble.Variant(i)->TimelineDigest());
+	}
+	return elapsed.count();
+}
+
+int main() {
+	const int configs[][2] = { { 16, 16 }, { 16, 64 }, { 30, 16 }, { 30, 64 }, { 60, 16 } };
+	int failures = 0;
+	printf("%6s %6s %14s %14s\n", "balls", "shots", "one-by-one ms", "ensemble ms");
+	for (const auto &config : configs) {
+		int balls = config[0], shots = config[1];
+		std::vector<std::uint64_t> alone, together;
+		double best_alone = Infinity, best_together = Infinity;
+		for (int r = 0; r < repeats; r++) {
+			best_alone = std::min(best_alone, Search(balls, shots, false, &alone));
+			best_together = std::min(best_together, Search(balls, shots, true, &together));
+		}
+		if (alone != together) {
+			printf("  %d balls, %d shots: variants differ from running alone\n", balls, shots);
+			failures++;
+		}
+		printf("%6d %6d %14.1f %14.1f\n", balls, shots, best_alone, best_together);
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+// PairKernels times Circle::TimeUntilCollide for each pair motion class,
+// and checks its results against solving the same pairs with the full
+// quartic. For before and after numbers, run it against a normal build of
+// SharpPhysics and against one with SHARPPHYSICS_GENERAL_KERNEL_ONLY defined,
+// which sends every pair down the quartic path.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "../Body.h"
+#include "../Math.h"
+
+using namespace SharpPhysics;
+
+static const int pairs_per_class = 20000;
+static const int repeats = 25;
+
+// A PairSet holds the pairs for one motion class, as circles[2i] and
+// circles[2i+1].
+struct PairSet {
+	const char *name;
+	std::vector<BodyInfo> infos;
+	std::vector<Circle> circles;
+};
+
+// MakeSet makes pairs_per_class pairs of circles, the second of each
+// scattered around the first, with velocities from 'velocity' and
+// frictions from 'friction'.
+template <typename VelocityFunc, typename FrictionFunc>
+static PairSet MakeSet(const char *name, std::mt19937_64 *rng, VelocityFunc velocity, FrictionFunc friction) {
+	std::uniform_real_distribution<spf> offset(-3, 3);
+	PairSet set{ name };
+	set.infos.reserve(pairs_per_class * 2);
+	set.circles.reserve(pairs_per_class * 2);
+	for (int i = 0; i < pairs_per_class * 2; i++) {
+		set.infos.push_back(BodyInfo{ i, nullptr, friction(i), 1.0, 0.5 });
+		Point2d pos = (i % 2) ? Point2d{ offset(*rng), offset(*rng) } : Point2d{ 0, 0 };
+		set.circles.push_back(Circle(&set.infos.back(), pos));
+		Vec2d v = velocity(i);
+		if (v.x != 0 || v.y != 0) set.circles.back().AddVelocity(v);
+	}
+	return set;
+}
+
+// ReferenceTime solves a pair with ApproachQuartic and SolveQuartic, as
+// Circle::TimeUntilCollide did before the motion classes.
+static Duration ReferenceTime(const Circle &a, const Circle &b) {
+	spf combined_radius = a.Radius() + b.Radius();
+	spf coef[5];
+	ApproachQuartic(b.Position() - a.Position(), b.Velocity() - a.Velocity(), b.Acceleration() - a.Acceleration(), combined_radius * combined_radius, coef);
+	return SolveQuartic(coef[0], coef[1], coef[2], coef[3], coef[4], true);
+}
+
+// UntilStop returns the earliest time either body of a pair stops; their
+// motion (and so any collision time) is only meaningful before then.
+static Duration UntilStop(const Circle &a, const Circle &b) {
+	Duration stop = Infinity;
+	for (const Circle *c : { &a, &b }) {
+		if (!c->IsStopped() && c->Friction() > 0) stop = std::min(stop, c->TimeUntilStop());
+	}
+	return stop;
+}
+
+// IsContactAt returns true if a pair is touching at time t.
+static bool IsContactAt(const Circle &a, const Circle &b, Duration t) {
+	spf dist = (b.PositionAfterDuration(t) - a.PositionAfterDuration(t)).Magnitude();
+	return std::abs(dist - (a.Radius() + b.Radius())) <= 1e-9;
+}
+
+int main() {
+	std::mt19937_64 rng(26);
+	std::uniform_real_distribution<spf> speed(-4, 4);
+	std::vector<PairSet> sets;
+	Vec2d shared{ 1.5, -0.5 };
+	sets.push_back(MakeSet("Static", &rng, [&](int i) { return shared; }, [](int i) { return 0.0; }));
+	sets.push_back(MakeSet("Linear", &rng, [&](int i) { return Vec2d{ speed(rng), speed(rng) }; }, [](int i) { return 0.0; }));
+	sets.push_back(MakeSet("Collinear", &rng, [&](int i) { return (i % 2) ? Vec2d{ speed(rng), speed(rng) } : Vec2d::Zero; }, [](int i) { return 0.3; }));
+	sets.push_back(MakeSet("General", &rng, [&](int i) { return Vec2d{ speed(rng), speed(rng) }; }, [](int i) { return 0.3; }));
+
+	int failures = 0, quartic_misses = 0;
+	printf("%-10s %10s %10s\n", "class", "ns/pair", "collisions");
+	for (const auto &set : sets) {
+		std::vector<Duration> times(pairs_per_class);
+		double best_ns = Infinity;
+		for (int r = 0; r < repeats; r++) {
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < pairs_per_class; i++) {
+				times[i] = set.circles[2 * i].TimeUntilCollide(set.circles[2 * i + 1], Infinity);
+			}
+			std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+			best_ns = std::min(best_ns, elapsed.count() / pairs_per_class);
+		}
+		int collisions = 0;
+		for (int i = 0; i < pairs_per_class; i++) {
+			const Circle &a = set.circles[2 * i], &b = set.circles[2 * i + 1];
+			Duration stop = UntilStop(a, b);
+			Duration expected = ReferenceTime(a, b);
+			if (expected > stop) expected = NaN;
+			Duration got = (times[i] > stop) ? NaN : times[i];
+			if (!std::isnan(got)) collisions++;
+			// The kernels solve the same equation different ways, so they
+			// only agree to within rounding. The quartic solver can also miss
+			// a root near a tangency; a time it missed is checked directly.
+			bool agree = std::isnan(expected) ? std::isnan(got) : std::abs(expected - got) <= 1e-6 * std::max(1.0, expected);
+			if (!agree && std::isnan(expected) && IsContactAt(a, b, got)) {
+				quartic_misses++;
+			}
+			else if (!agree && ++failures <= 10) {
+				printf("  %s pair %d: expected %.17g, got %.17g\n", set.name, i, expected, got);
+			}
+		}
+		printf("%-10s %10.1f %10d\n", set.name, best_ns, collisions);
+	}
+	if (quartic_misses) printf("%d collisions found that the quartic missed\n", quartic_misses);
+	if (failures) printf("%d pairs disagree with the quartic\n", failures);
+	return failures ? 1 : 0;
+}
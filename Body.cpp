@@ -1,11 +1,105 @@
 #include <algorithm>
 #include "Body.h"
 #include "Math.h"
+#include "Stats.h"
 
 namespace SharpPhysics {
 	BodyType Circle::Type = "Circle";
 	BodyType Line::Type = "Line";
 
+	// Positions recomputed at a transition can land a rounding error short of
+	// the contact they were computed for. When deciding whether a body is
+	// inside an intangible body, anything within contact_eps (relative to the
+	// contact distance) of the boundary counts as on it, so the same entry or
+	// exit isn't found again a moment later.
+	static const spf contact_eps = 1e-9;
+
+	// The relative motion of two circles falls into one of these classes,
+	// depending on which of them is stopped, frictionless or decelerating.
+	// Each class has its own kernel for the time they reach a distance, so
+	// only the General class pays for the full quartic. Defining
+	// SHARPPHYSICS_GENERAL_KERNEL_ONLY sends every pair to the quartic, as
+	// before there were classes, eg. to benchmark the others against it.
+	enum class PairMotion {
+		Static,     // No relative motion at all.
+		Linear,     // No relative acceleration (eg. both frictionless, or one stopped and the other frictionless).
+		Collinear,  // One stopped and the other decelerating, so they move relative to each other along a line.
+		General,
+	};
+
+	static PairMotion ClassifyPair(const Body &a, const Body &b, const Vec2d &relvel, const Vec2d &relaccel) {
+#ifdef SHARPPHYSICS_GENERAL_KERNEL_ONLY
+		return PairMotion::General;
+#endif
+		if (relaccel.x == 0 && relaccel.y == 0) {
+			return (relvel.x == 0 && relvel.y == 0) ? PairMotion::Static : PairMotion::Linear;
+		}
+		if (a.IsStopped() || b.IsStopped()) return PairMotion::Collinear;
+		return PairMotion::General;
+	}
+
+	// ApproachTime returns the first time at which two points with relative
+	// position p, velocity v and acceleration acc come to sqrt(dist_squared)
+	// apart: moving together, or moving apart if leaving is true. Returns NaN
+	// if they don't.
+	template <PairMotion M>
+	static spf ApproachTime(const Vec2d &p, const Vec2d &v, const Vec2d &acc, spf dist_squared, bool leaving);
+
+	template <>
+	spf ApproachTime<PairMotion::Static>(const Vec2d &p, const Vec2d &v, const Vec2d &acc, spf dist_squared, bool leaving) {
+		SHARPPHYSICS_COUNT(StaticPairs);
+		return NaN;
+	}
+
+	template <>
+	spf ApproachTime<PairMotion::Linear>(const Vec2d &p, const Vec2d &v, const Vec2d &acc, spf dist_squared, bool leaving) {
+		SHARPPHYSICS_COUNT(LinearPairs);
+		// |p + vt|^2 = dist_squared, the quartic with its top two terms zero.
+		spf sign = leaving ? -1.0 : 1.0;
+		return SolveQuadratic(sign * Vec2d::Dot(v, v), sign * 2 * Vec2d::Dot(p, v), sign * (Vec2d::Dot(p, p) - dist_squared), true);
+	}
+
+	template <>
+	spf ApproachTime<PairMotion::Collinear>(const Vec2d &p, const Vec2d &v, const Vec2d &acc, spf dist_squared, bool leaving) {
+		SHARPPHYSICS_COUNT(CollinearPairs);
+		// acc = k*v, so the relative position is p + v*s where s = t + k/2 t^2.
+		// Solve the quadratic |p + vs|^2 = dist_squared for s, then each s for t.
+		spf sign = leaving ? -1.0 : 1.0;
+		spf a = Vec2d::Dot(v, v), b = 2 * Vec2d::Dot(p, v), c = Vec2d::Dot(p, p) - dist_squared;
+		spf k = Vec2d::Dot(acc, v) / a;
+		spf discriminant = MulAdd(b, b, -(4 * a*c));
+		if (discriminant < 0) return NaN;
+		spf best = NaN;
+		for (spf s : { (-b + std::sqrt(discriminant)) / (2 * a), (-b - std::sqrt(discriminant)) / (2 * a) }) {
+			spf grade_s = sign * MulAdd(2 * a, s, b);
+			// k/2 t^2 + t - s = 0
+			spf ts[2] = { s, NaN };
+			if (k != 0) {
+				spf discriminant_t = MulAdd(2 * k, s, 1);
+				if (discriminant_t < 0) continue;
+				ts[0] = (-1 + std::sqrt(discriminant_t)) / k;
+				ts[1] = (-1 - std::sqrt(discriminant_t)) / k;
+			}
+			for (spf t : ts) {
+				if (!(t > 0)) continue;  // No collisions backwards in time.
+				if (grade_s * MulAdd(k, t, 1) > 0) continue;  // Moving the wrong way through the distance.
+				best = std::fmin(best, t);
+			}
+		}
+		return best;
+	}
+
+	template <>
+	spf ApproachTime<PairMotion::General>(const Vec2d &p, const Vec2d &v, const Vec2d &acc, spf dist_squared, bool leaving) {
+		SHARPPHYSICS_COUNT(GeneralPairs);
+		spf coef[5];
+		ApproachQuartic(p, v, acc, dist_squared, coef);
+		// Negating the polynomial keeps its roots but flips the sign of its
+		// gradient, so only_inward then keeps only the outward roots.
+		spf sign = leaving ? -1.0 : 1.0;
+		return SolveQuartic(sign * coef[0], sign * coef[1], sign * coef[2], sign * coef[3], sign * coef[4], true);
+	}
+
 	std::unique_ptr<Body> Circle::CopyAfterDuration(Duration d) const {
 		std::unique_ptr<Body> c(new Circle(*this));
 		c->SetPosition(PositionAfterDuration(d));
@@ -18,30 +112,42 @@ namespace SharpPhysics {
 	}
 
 	Duration Circle::TimeUntilCollide(const Circle &other, Duration maxtime) const {
-		Vec2d pos_maxt = PositionAfterDuration(maxtime);
-		Vec2d other_pos_maxt = other.PositionAfterDuration(maxtime);
-		spf distSquared = LineSegsDistanceSquared(LineSeg{ Position(), pos_maxt }, LineSeg{ other.Position(), other_pos_maxt });
-		spf combined_radius_squared = std::pow(Radius() + other.Radius(), 2);
-		if (distSquared > combined_radius_squared)
+		SHARPPHYSICS_COUNT(PairChecks);
+		Vec2d pos_maxt = PathEndAfterDuration(maxtime);
+		Vec2d other_pos_maxt = other.PathEndAfterDuration(maxtime);
+		spf combined_radius_squared = (Radius() + other.Radius()) * (Radius() + other.Radius());
+		if (LineSegsFartherThan(LineSeg{ Position(), pos_maxt }, LineSeg{ other.Position(), other_pos_maxt }, combined_radius_squared))
 		{  // discs don't even cross paths in the given time range, so cheap no collision.
+			SHARPPHYSICS_COUNT(SweptRejections);
 			return NaN;
 		}
 		Vec2d relvel = other.Velocity() - Velocity();
 		Vec2d relpos = other.Position() - Position();
 		Vec2d relaccel = other.Acceleration() - Acceleration();
-		// DistAtTime = relpos + relvel * t + relaccel * t^2 / 2;
-		// xt = rpx + rvx*t + rax/2*t^2;
-		// yt = rpy + rvy*t + ray/2*t^2;
-		// collision when xt^2 + yt^2 = (combined_radius)^2
-		// xt^2 = rpx^2 + rpx*rvx*2*t + rpx*rax*t^2 + rvx^2*t^2 + rvx*rax*t^3 + rax^2/4*t^4;
-		// (rax^2/4)t^4 + (rvx*rax)t^3 + (rvx^2 + rpx*rax)t^2 + (rpx*rvx*2)t + rpx^2
-		// Collision when at^4 + bt^3 + ct^2 + dt + e = 0
-		spf a = (std::pow(relaccel.x,2) + std::pow(relaccel.y,2)) / 4;
-		spf b = (relvel.x * relaccel.x + relvel.y * relaccel.y);
-		spf c = std::pow(relvel.x,2) + std::pow(relvel.y,2) + (relpos.x * relaccel.x + relpos.y * relaccel.y);
-		spf d = (relpos.x * relvel.x + relpos.y * relvel.y) * 2;
-		spf e = std::pow(relpos.x,2) + std::pow(relpos.y,2) - combined_radius_squared;
-		spf t = SolveQuartic(a, b, c, d, e, other.IsTangible());
+		bool leaving = false;
+		if (!IsTangible() || !other.IsTangible()) {
+			// One of us is a trigger, so the next event is entering it if we're
+			// outside, or leaving it if we're inside. On the boundary, moving
+			// inwards means we just entered.
+			spf tolerance = combined_radius_squared * contact_eps;
+			spf e = Vec2d::Dot(relpos, relpos) - combined_radius_squared;
+			leaving = e < -tolerance || (e <= tolerance && Vec2d::Dot(relpos, relvel) < 0);
+		}
+		spf t;
+		switch (ClassifyPair(*this, other, relvel, relaccel)) {
+		case PairMotion::Static:
+			t = ApproachTime<PairMotion::Static>(relpos, relvel, relaccel, combined_radius_squared, leaving);
+			break;
+		case PairMotion::Linear:
+			t = ApproachTime<PairMotion::Linear>(relpos, relvel, relaccel, combined_radius_squared, leaving);
+			break;
+		case PairMotion::Collinear:
+			t = ApproachTime<PairMotion::Collinear>(relpos, relvel, relaccel, combined_radius_squared, leaving);
+			break;
+		default:
+			t = ApproachTime<PairMotion::General>(relpos, relvel, relaccel, combined_radius_squared, leaving);
+			break;
+		}
 		if (t > maxtime) return NaN;
 		return t;
 	}
@@ -52,10 +158,11 @@ namespace SharpPhysics {
 	}
 
 	Duration Circle::TimeUntilCollide(const Line &other, Duration maxtime) const {
-		Vec2d pos_maxt = PositionAfterDuration(maxtime); 
-		spf distSquared = LineSegsDistanceSquared(LineSeg{ Position(), pos_maxt }, other.LinePos());
-		spf radius_squared = std::pow(Radius(), 2);
-		if (distSquared > radius_squared) {
+		SHARPPHYSICS_COUNT(PairChecks);
+		Vec2d pos_maxt = PathEndAfterDuration(maxtime);
+		spf radius_squared = Radius() * Radius();
+		if (LineSegsFartherThan(LineSeg{ Position(), pos_maxt }, other.LinePos(), radius_squared)) {
+			SHARPPHYSICS_COUNT(SweptRejections);
 			return NaN;  // no contact in the given time range.
 		}
 		Vec2d other_normal = other.Normal();
@@ -63,23 +170,42 @@ namespace SharpPhysics {
 		Vec2d other_dir = other_line.b - other_line.a;
 		// The vector between a point on the line and a point off the line, projected into the normal, equals the distance from line to point.
 		spf normalDist = Vec2d::Dot(Position() - other_line.a, other_normal);
-		spf sign = signbit(normalDist) ? -1.0 : 1.0;
-		if (std::abs(normalDist) > radius) {
-			// We're not already overlapping the infiniline, so we should consider the main line collision first.
-			spf normalVel = Vec2d::Dot(Velocity(), other_normal);
-			spf normalAccel = Vec2d::Dot(Acceleration(), other_normal);
-			spf collisionDist = normalDist + radius * sign;
-			// 1/2a t^2 + v t + collisionDist = 0
-			spf t = SolveQuadratic(normalAccel / 2, normalVel, collisionDist, other.IsTangible());
+		spf normalVel = Vec2d::Dot(Velocity(), other_normal);
+		spf normalAccel = Vec2d::Dot(Acceleration(), other_normal);
+		spf t = NaN;
+		if (other.IsTangible()) {
+			if (std::abs(normalDist) > Radius()) {
+				// We're not already overlapping the infiniline, so we should consider the main line collision first.
+				// With the normal flipped to point at us, we touch when the distance comes down to radius:
+				// 1/2a t^2 + v t + (dist - radius) = 0
+				spf sign = std::signbit(normalDist) ? -1.0 : 1.0;
+				t = SolveQuadratic(sign * normalAccel / 2, sign * normalVel, std::abs(normalDist) - Radius(), true);
+			}
+		}
+		else {
+			// An intangible line is passed through rather than bounced off. With the
+			// normal flipped to point along our travel, the distance only increases;
+			// we enter the line when it reaches -radius and leave it at +radius.
+			spf sign = std::signbit(normalVel) ? -1.0 : 1.0;
+			spf dist = sign * normalDist;
+			spf radius = Radius();
+			spf tolerance = radius * contact_eps;
+			if (dist < radius - tolerance) {
+				spf edge = (dist < -radius - tolerance) ? -radius : radius;
+				// The distance rises through the edge, so its gradient there is positive; don't use only_inward.
+				t = SolveQuadratic(sign * normalAccel / 2, sign * normalVel, dist - edge, false);
+			}
+		}
+		if (!std::isnan(t)) {
 			Vec2d pos_collisiont = PositionAfterDuration(t);
 			spf d1 = Vec2d::Dot(pos_collisiont - other_line.a, other_dir);
 			spf d2 = Vec2d::Dot(pos_collisiont - other_line.b, other_dir);
-			if (signbit(d1) != signbit(d2)) {
+			if (std::signbit(d1) != std::signbit(d2)) {
 				// We're between the ends when we touch the infiniline - that means we also touched the lineseg, and we're done here.
 				return t;
 			}
 		}
-		return std::min(TimeUntilCollide(other_line.a, maxtime), TimeUntilCollide(other_line.b, maxtime));
+		return std::fmin(TimeUntilCollide(other_line.a, maxtime), TimeUntilCollide(other_line.b, maxtime));
 	}
 
 	Duration Circle::TimeUntilCollide(const Body &other, Duration maxtime) const {
@@ -96,8 +222,7 @@ namespace SharpPhysics {
 		Vec2d collision_dir = CollisionDir(*other);
 		spf avi = Vec2d::Dot(Velocity(), collision_dir);
 		if (std::isnan(other->Mass())) {
-			// Other object is intangible.
-			// TODO: Trigger things!
+			// Other object is intangible; System reports it as a TriggerEvent.
 			return;
 		}
 		else if (std::isinf(other->Mass())) {
@@ -112,11 +237,28 @@ namespace SharpPhysics {
 			AddVelocity(collision_dir * (avo - avi));
 			other->AddVelocity(collision_dir * (bvo - bvi));
 		}
-		// TODO: Trigger things.
 	}
 	bool Circle::IsTouchingPointAt(Duration t, Point2d p) const {
 		Point2d c = PositionAfterDuration(t);
-		return (p - c).SqrMagnitude() < std::pow(radius, 2);
+		return (p - c).SqrMagnitude() < Radius() * Radius();
+	}
+	bool Circle::IsApproaching(const Body &other) const {
+		if (other.GetType() == Circle::Type) {
+			return IsApproaching(static_cast<const Circle &>(other));
+		}
+		else if (other.GetType() == Line::Type) {
+			return IsApproaching(static_cast<const Line &>(other));
+		}
+		throw "Unexpected collision type";
+	}
+	bool Circle::IsApproaching(const Circle &other) const {
+		return Vec2d::Dot(other.Position() - Position(), Velocity() - other.Velocity()) > 0;
+	}
+	bool Circle::IsApproaching(const Line &other) const {
+		// Moving towards the line if our velocity is opposite our side of it.
+		spf normalDist = Vec2d::Dot(Position() - other.LinePos().a, other.Normal());
+		spf normalVel = Vec2d::Dot(Velocity(), other.Normal());
+		return normalDist * normalVel < 0;
 	}
 	Vec2d Circle::CollisionDir(const Body &other) const {
 		if (other.GetType() == Circle::Type) {
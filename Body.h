@@ -9,12 +9,24 @@ namespace SharpPhysics {
 	// ExtraData can be subclassed for bodies that want more data attached.
 	class ExtraData {};
 
+	// BodyInfo holds the properties of a body that never change. It's kept
+	// once per body (normally in System::body_info) rather than in every
+	// snapshot's copy of the body, which only holds the changing state; a
+	// BodyInfo must outlive every Body made with it.
+	struct BodyInfo {
+		BodyID id;
+		std::shared_ptr<ExtraData> extra;
+		spf friction, mass;  // friction is 1/f, so zero is infinite friction.
+		spf radius;  // For Circles.
+	};
+
 	// A Body represents an object with position, velocity, friction and mass.
 	// It's only useful for subclassing.
 	class Body {
 	public:
 		Body(const Body &src) = default;
-		Body(BodyID id, std::shared_ptr<ExtraData> e, Point2d pos, spf fric, spf mas) : ID(id), extra(e), position(pos), friction(fric), mass(mas), velocity(Vec2d::Zero), stopped(true) {}
+		Body(const BodyInfo *inf, Point2d pos) : ID(inf->id), stopped(true), info(inf), position(pos), velocity(Vec2d::Zero) {}
+		virtual ~Body() {}
 
 		// Override GetType with a function that returns a static const string;
 		// this makes dynamic type comparison easy. See class Line below for example.
@@ -40,68 +52,95 @@ namespace SharpPhysics {
 		// p after t, assuming no additional impulses.
 		virtual bool IsTouchingPointAt(Duration t, Point2d p) const = 0;
 
+		// IsApproaching returns true if this body is moving into contact with
+		// 'other' rather than out of it. At the moment of a collision with an
+		// intangible body, this distinguishes entering it from leaving it.
+		virtual bool IsApproaching(const Body &other) const = 0;
+
 		void Stop() { stopped = true; velocity = Vec2d::Zero; }
 		bool IsStopped() const { return stopped; }
-		bool IsTangible() const { return !std::isnan(mass); }
+		bool IsTangible() const { return !std::isnan(Mass()); }
 		const Point2d &Position() const { return position; }
 		void SetPosition(const Point2d &pos) { position = pos; }
 		const Vec2d &Velocity() const { return velocity; }
 		void SetVelocity(const Vec2d &v) { velocity = v; }
-		Point2d PositionAfterDuration(Duration t) const { return Position() + Velocity() * t + Acceleration() * (t * t / 2); }
-		Vec2d VelocityAfterDuration(Duration t) const { return Velocity() + Acceleration() * t; }
+		Point2d PositionAfterDuration(Duration t) const {
+			Vec2d a = Acceleration();
+			spf half_t2 = t * t / 2;
+			return Point2d{ MulAdd(a.x, half_t2, MulAdd(velocity.x, t, position.x)), MulAdd(a.y, half_t2, MulAdd(velocity.y, t, position.y)) };
+		}
+		// PathEndAfterDuration returns where the body's path over the next t
+		// ends: its position then, or where it stops if that's sooner (unlike
+		// PositionAfterDuration, which carries the deceleration on past the
+		// stop, back the way it came).
+		Point2d PathEndAfterDuration(Duration t) const {
+			if (stopped) return position;
+			if (Friction() > 0) t = std::fmin(t, TimeUntilStop());
+			return PositionAfterDuration(t);
+		}
+		Vec2d VelocityAfterDuration(Duration t) const { Vec2d a = Acceleration(); return Vec2d{ MulAdd(a.x, t, velocity.x), MulAdd(a.y, t, velocity.y) }; }
 		Vec2d Acceleration() const { return velocity.Normalized() * -Friction(); }
-		const spf &Friction() const { return friction; }
-		const spf &Mass() const { return mass; }
+		const spf &Friction() const { return info->friction; }
+		const spf &Mass() const { return info->mass; }
 		Duration TimeUntilStop() const { return Velocity().Magnitude() / Friction(); }
-		void AddVelocity(Vec2d add) { velocity += add; stopped = false; }
-		ExtraData *Extra() const { return extra.get(); }
+		// AddVelocity stops the body if its velocity comes to exactly zero,
+		// so a body is never left moving without going anywhere.
+		void AddVelocity(Vec2d add) {
+			velocity += add;
+			if (velocity.x == 0 && velocity.y == 0) Stop();
+			else stopped = false;
+		}
+		ExtraData *Extra() const { return info->extra.get(); }
+		const BodyInfo &Info() const { return *info; }
 		BodyID ID;
 	protected:
-		std::shared_ptr<ExtraData> extra;
-		bool stopped;
+		bool stopped;  // Next to ID, so they share a word.
+		const BodyInfo *info;
 		Point2d position;
 		Vec2d velocity;
-		spf friction, mass;  // friction is 1/f, so zero is infinite friction.
 	};
 
-	// A Line is a static Body with infinite mass.
+	// A Line is a static Body with infinite mass (in its BodyInfo), or with
+	// NaN mass for an intangible line (eg. a trigger) that circles pass through.
 	class Line : public Body {
 	public:
 		Line(const Line &src) = default;
-		Line(BodyID id, std::shared_ptr<ExtraData> e, const Point2d &start, const Point2d &end) : Body(id, e, start, 0.0, Infinity), b(end) {}
+		Line(const BodyInfo *info, const Point2d &start, const Point2d &end) : Body(info, start), b(end), normal(Vec2d{ start.y - end.y, end.x - start.x }.Normalized()) {}
 		BodyType GetType() const override { return Type; }
 		static BodyType Type;
 		std::unique_ptr<Body> CopyAfterDuration(Duration t) const override;
 		Duration TimeUntilCollide(const Body &other, Duration maxtime = Infinity) const override { return NaN; };
 		void ApplyCollision(Body *other) override {}
 		bool IsTouchingPointAt(Duration t, Point2d p) const override { return false; }
-		Vec2d Normal() const { return Vec2d{ position.y - b.y, b.x - position.x }.Normalized(); }
+		bool IsApproaching(const Body &other) const override { return false; }
+		const Vec2d &Normal() const { return normal; }
 		LineSeg LinePos() const { return LineSeg{ position, b }; }
 	protected:
 		Point2d b;
+		Vec2d normal;  // Lines never move, so this is worked out once.
 	};
 
 	// A Circle is the main dynamic body type.
 	class Circle : public Body {
 	public:
-		Circle(const Circle &src, Duration d);
-		Circle(BodyID id, std::shared_ptr<ExtraData> e, const Point2d &pos, spf r, spf fric = 0.0, spf mas = Infinity) : Body(id, e, pos, fric, mas), radius(r) {}
+		Circle(const BodyInfo *info, const Point2d &pos) : Body(info, pos) {}
 		BodyType GetType() const override { return Type; }
 		static BodyType Type;
 		std::unique_ptr<Body> CopyAfterDuration(Duration t) const override;
 		Duration TimeUntilCollide(const Body &other, Duration maxtime = Infinity) const override;
 		void ApplyCollision(Body *other) override;
 		bool IsTouchingPointAt(Duration t, Point2d p) const override;
+		bool IsApproaching(const Body &other) const override;
 
-		const spf &Radius() const { return radius; }
+		const spf &Radius() const { return info->radius; }
 		Duration TimeUntilCollide(const Circle &other, Duration maxtime = Infinity) const;
 		Duration TimeUntilCollide(const Line &other, Duration maxtime = Infinity) const;
 		Duration TimeUntilCollide(const Point2d &point, Duration maxtime = Infinity) const;
 		Vec2d CollisionDir(const Body &other) const;
 		Vec2d CollisionDir(const Circle &other) const;
 		Vec2d CollisionDir(const Line &other) const;
-	protected:
-		spf radius;
+		bool IsApproaching(const Circle &other) const;
+		bool IsApproaching(const Line &other) const;
 	};
 }
 #endif // __SHARPPHYSICS_BODY_H_
@@ -0,0 +1,333 @@
+#include "Ensemble.h"
+
+namespace SharpPhysics {
+	// Bounds only stand in for segments whose coordinates are all finite and
+	// this small, so that, as BoundsFartherThan needs, the coordinates of a
+	// pair of them can't add up to anything but a finite number.
+	static const spf max_bounded_magnitude = 1e300;
+	static bool IsBounded(const LineSeg &l, const SegBounds &b) {
+		return std::isfinite(l.a.x + l.a.y + l.b.x + l.b.y) && b.magnitude <= max_bounded_magnitude;
+	}
+
+	Ensemble::Ensemble(System *b) : base(b) {
+		if (base->snapshots.empty()) throw "Ensemble needs a base System with a snapshot";
+	}
+
+	size_t Ensemble::AddVariant() {
+		std::unique_ptr<System> variant(new System());
+		variant->shared_fixtures = &base->Fixtures();
+		variant->coalesce_window = base->coalesce_window;
+		variant->prediction_window = base->prediction_window;
+		variant->query_cell_size = base->query_cell_size;
+		variant->branch_cache_size = base->branch_cache_size;
+		variant->last_interval = base->last_interval;
+		variant->trigger_subscribers = base->trigger_subscribers;
+
+		// Copy the latest snapshot exactly; its Bodies keep pointing at the
+		// base's BodyInfo.
+		auto latest = std::prev(base->snapshots.cend());
+		std::unique_ptr<Snapshot> ss(new Snapshot());
+		for (const auto &b : latest->second->bodies) {
+			std::unique_ptr<Body> body = b.second->CopyAfterDuration(0);
+			body->SetPosition(b.second->Position());
+			body->SetVelocity(b.second->Velocity());
+			ss->bodies.emplace_hint(ss->bodies.end(), b.first, std::move(body));
+		}
+		variant->snapshots.emplace(latest->first, std::move(ss));
+		variant->input_queue.insert(base->input_queue.upper_bound(latest->first), base->input_queue.end());
+		variant->input_keys.insert(base->input_keys.upper_bound(latest->first), base->input_keys.end());
+		variant->Calculate();
+		variants.push_back(std::move(variant));
+		return variants.size() - 1;
+	}
+
+	void Ensemble::CalculateToTime(Timestamp t) {
+		for (auto &variant : variants) {
+			variant->TakeSubmittedInputs();
+		}
+		StepWhile([t](const System &variant) { return t > variant.NextTransitionTime(); });
+		for (auto &variant : variants) {
+			variant->DeliverTriggerEvents();
+		}
+	}
+
+	std::vector<Timestamp> Ensemble::CalculateToRest(Timestamp deadline) {
+		for (auto &variant : variants) {
+			variant->TakeSubmittedInputs();
+		}
+		StepWhile([deadline](const System &variant) { return !variant.quiescent && variant.NextTransitionTime() <= deadline; });
+		std::vector<Timestamp> rest;
+		rest.reserve(variants.size());
+		for (auto &variant : variants) {
+			variant->DeliverTriggerEvents();
+			rest.push_back(variant->quiescent ? std::prev(variant->snapshots.cend())->first : NaN);
+		}
+		return rest;
+	}
+
+	void Ensemble::StepWhile(const std::function<bool(const System &)> &should_step) {
+		std::vector<System *> stepping;
+		for (;;) {
+			stepping.clear();
+			for (auto &variant : variants) {
+				if (should_step(*variant)) stepping.push_back(variant.get());
+			}
+			if (stepping.empty()) return;
+			for (System *variant : stepping) {
+				SHARPPHYSICS_STATS_SCOPE(&variant->stats);
+				variant->AddNextSnapshot();
+			}
+			Calculate(stepping);
+		}
+	}
+
+	void Ensemble::Calculate(const std::vector<System *> &stepped) {
+		lanes.clear();
+		searches.clear();
+		const Snapshot *ref = nullptr;
+		for (System *variant : stepped) {
+			SHARPPHYSICS_STATS_SCOPE(&variant->stats);
+			SHARPPHYSICS_COUNT(Calculates);
+			System::CollisionSearch search;
+			if (!variant->BeginCalculate(&search)) continue;
+			auto latest = std::prev(variant->snapshots.cend());
+			if (!ref) ref = latest->second.get();
+			if (InStep(*ref, *latest->second)) {
+				lanes.push_back(variant);
+				searches.push_back(search);
+				continue;
+			}
+			// Diverged, so search it as System::Calculate would.
+			do {
+				variant->FindCollisions(*latest->second, latest->first, search.window);
+			} while (variant->WidenSearch(&search));
+			variant->EndCalculate();
+		}
+		if (lanes.empty()) return;
+		Gather();
+		for (bool any = true; any;) {
+			FindCollisions();
+			any = false;
+			for (size_t l = 0; l < lanes.size(); l++) {
+				if (!searching[l]) continue;
+				SHARPPHYSICS_STATS_SCOPE(&lanes[l]->stats);
+				searching[l] = lanes[l]->WidenSearch(&searches[l]);
+				UpdateMaxtime(l);
+				any = any || searching[l];
+			}
+		}
+		for (System *lane : lanes) {
+			lane->EndCalculate();
+		}
+	}
+
+	bool Ensemble::InStep(const Snapshot &ref, const Snapshot &ss) {
+		if (ss.bodies.size() != ref.bodies.size()) return false;
+		for (auto a = ref.bodies.begin(), b = ss.bodies.begin(); a != ref.bodies.end(); a++, b++) {
+			if (a->first != b->first || &a->second->Info() != &b->second->Info() || a->second->GetType() != b->second->GetType()) return false;
+		}
+		return true;
+	}
+
+	void Ensemble::Gather() {
+		size_t lane_count = lanes.size();
+		const Snapshot &ref = *std::prev(lanes[0]->snapshots.cend())->second;
+		size_t body_count = ref.bodies.size();
+		times.resize(lane_count);
+		maxtimes.resize(lane_count);
+		searching.assign(lane_count, true);
+#ifdef SHARPPHYSICS_STATS
+		rejections.assign(lane_count, 0);
+#endif
+		bodies.resize(body_count * lane_count);
+		moving.resize(body_count * lane_count);
+		paths.resize(body_count * lane_count);
+		for (auto *field : { &min_x, &max_x, &min_y, &max_y, &magnitude }) {
+			field->resize(body_count * lane_count);
+		}
+		bounded.resize(body_count * lane_count);
+		rejected.resize(lane_count);
+		for (size_t l = 0; l < lane_count; l++) {
+			auto latest = std::prev(lanes[l]->snapshots.cend());
+			times[l] = latest->first;
+			maxtimes[l] = std::fmin(searches[l].window, lanes[l]->Horizon());
+			size_t i = l;
+			for (const auto &b : latest->second->bodies) {
+				bodies[i] = b.second.get();
+				moving[i] = !b.second->IsStopped();
+				paths[i].a = b.second->Position();
+				// A stopped body's path is where it is, whatever the maxtime.
+				Sweep(i, maxtimes[l]);
+				i += lane_count;
+			}
+		}
+		circles.resize(body_count);
+		radii.resize(body_count);
+		size_t k = 0;
+		for (const auto &b : ref.bodies) {
+			circles[k] = b.second->GetType() == Circle::Type;
+			radii[k] = circles[k] ? static_cast<const Circle &>(*b.second).Radius() : 0;
+			k++;
+		}
+		const Snapshot &fixed = lanes[0]->Fixtures();
+		fixture_lines.resize(fixed.bodies.size());
+		fixture_segs.resize(fixed.bodies.size());
+		fixture_bounds.resize(fixed.bodies.size());
+		fixture_bounded.resize(fixed.bodies.size());
+		size_t f = 0;
+		for (const auto &b : fixed.bodies) {
+			fixture_lines[f] = b.second->GetType() == Line::Type;
+			if (fixture_lines[f]) {
+				const LineSeg &seg = fixture_segs[f] = static_cast<const Line &>(*b.second).LinePos();
+				fixture_bounds[f] = BoundsOf(seg);
+				fixture_bounded[f] = IsBounded(seg, fixture_bounds[f]);
+			}
+			f++;
+		}
+	}
+
+	void Ensemble::Sweep(size_t i, Duration maxtime) {
+		LineSeg &path = paths[i];
+		path.b = bodies[i]->PathEndAfterDuration(maxtime);
+		SegBounds b = BoundsOf(path);
+		min_x[i] = b.min_x;
+		max_x[i] = b.max_x;
+		min_y[i] = b.min_y;
+		max_y[i] = b.max_y;
+		magnitude[i] = b.magnitude;
+		bounded[i] = IsBounded(path, b);
+	}
+
+	void Ensemble::UpdateMaxtime(size_t l) {
+		// A lane's maxtime only changes when it finds a collision or widens,
+		// so this is rare next to the pair checks that use the paths.
+		Duration maxtime = std::fmin(searches[l].window, lanes[l]->Horizon());
+		if (maxtime == maxtimes[l]) return;
+		maxtimes[l] = maxtime;
+		for (size_t i = l; i < bodies.size(); i += lanes.size()) {
+			if (moving[i]) Sweep(i, maxtime);
+		}
+	}
+
+	SegBounds Ensemble::BoundsAt(size_t i) const {
+		return SegBounds{ min_x[i], max_x[i], min_y[i], max_y[i], magnitude[i] };
+	}
+
+	void Ensemble::RejectLanes(size_t k, size_t j, size_t from, size_t to, spf dist_squared) {
+		size_t lane_count = lanes.size();
+		const spf *x0 = min_x.data(), *x1 = max_x.data(), *y0 = min_y.data(), *y1 = max_y.data(), *m = magnitude.data();
+		size_t body = k * lane_count, other = j * lane_count;
+		spf *out = rejected.data();
+		for (size_t l = from; l < to; l++) {
+			SegBounds b1{ x0[body + l], x1[body + l], y0[body + l], y1[body + l], m[body + l] };
+			SegBounds b2{ x0[other + l], x1[other + l], y0[other + l], y1[other + l], m[other + l] };
+			out[l] = BoundsFartherThan(b1, b2, dist_squared) ? 1 : 0;
+		}
+	}
+
+	void Ensemble::RejectFixtureLanes(size_t k, size_t f, size_t from, size_t to, spf dist_squared) {
+		size_t lane_count = lanes.size();
+		const spf *x0 = min_x.data(), *x1 = max_x.data(), *y0 = min_y.data(), *y1 = max_y.data(), *m = magnitude.data();
+		size_t body = k * lane_count;
+		SegBounds fixture = fixture_bounds[f];
+		spf *out = rejected.data();
+		for (size_t l = from; l < to; l++) {
+			SegBounds b{ x0[body + l], x1[body + l], y0[body + l], y1[body + l], m[body + l] };
+			out[l] = BoundsFartherThan(b, fixture, dist_squared) ? 1 : 0;
+		}
+	}
+
+	bool Ensemble::SweptApart(size_t i, size_t other, size_t l, bool masked, spf dist_squared) const {
+		if (!bounded[i] || !bounded[other]) return BoundsFartherThan(paths[i], paths[other], dist_squared);
+		if (masked) return rejected[l] != 0;
+		return BoundsFartherThan(BoundsAt(i), BoundsAt(other), dist_squared);
+	}
+
+	bool Ensemble::FixtureSweptApart(size_t i, size_t f, size_t l, bool masked, spf dist_squared) const {
+		if (!bounded[i] || !fixture_bounded[f]) return BoundsFartherThan(paths[i], fixture_segs[f], dist_squared);
+		if (masked) return rejected[l] != 0;
+		return BoundsFartherThan(BoundsAt(i), fixture_bounds[f], dist_squared);
+	}
+
+	void Ensemble::FindCollisions() {
+		size_t lane_count = lanes.size();
+		size_t body_count = circles.size();
+		// Each lane checks its pairs in the same order as System::FindCollisions,
+		// so its candidates come out in the same order too.
+		for (size_t k = 0; k < body_count; k++) {
+			size_t body = k * lane_count;
+			// Most bodies are stopped in most lanes, so rather than masking
+			// lanes off pair by pair, list the lanes this one moves in.
+			active.clear();
+			for (size_t l = 0; l < lane_count; l++) {
+				if (searching[l] && moving[body + l]) active.push_back(l);
+			}
+			if (active.empty()) continue;
+			// The mask covers every lane from the first active one to the last;
+			// if only a few of those are active, test them one by one instead.
+			size_t from = active.front(), to = active.back() + 1;
+			bool masked = active.size() * 2 >= to - from;
+			for (size_t j = 0; j < body_count; j++) {
+				if (j == k) continue;
+				size_t other = j * lane_count;
+				// Only stopped bodies earlier than this one; moving ones checked
+				// this pair already.
+				bool only_stopped = j < k;
+				bool both_circles = circles[k] && circles[j];
+				spf combined_radius_squared = (radii[k] + radii[j]) * (radii[k] + radii[j]);
+				if (both_circles && masked) RejectLanes(k, j, from, to, combined_radius_squared);
+				for (size_t l : active) {
+					if (only_stopped && moving[other + l]) continue;
+					if (both_circles && SweptApart(body + l, other + l, l, masked, combined_radius_squared)) {
+#ifdef SHARPPHYSICS_STATS
+						rejections[l]++;
+#endif
+						continue;
+					}
+					SHARPPHYSICS_STATS_SCOPE(&lanes[l]->stats);
+					lanes[l]->CheckPair(times[l], *bodies[body + l], *bodies[other + l], searches[l].window);
+					UpdateMaxtime(l);
+				}
+			}
+			const Snapshot &fixed = lanes[0]->Fixtures();
+			size_t f = 0;
+			for (auto it = fixed.bodies.begin(); it != fixed.bodies.end(); it++, f++) {
+				bool line = circles[k] && fixture_lines[f];
+				spf radius_squared = radii[k] * radii[k];
+				if (line && masked) RejectFixtureLanes(k, f, from, to, radius_squared);
+				for (size_t l : active) {
+					if (line && FixtureSweptApart(body + l, f, l, masked, radius_squared)) {
+#ifdef SHARPPHYSICS_STATS
+						rejections[l]++;
+#endif
+						continue;
+					}
+					SHARPPHYSICS_STATS_SCOPE(&lanes[l]->stats);
+					lanes[l]->CheckFixture(times[l], *bodies[body + l], it->second.get(), searches[l].window);
+					UpdateMaxtime(l);
+				}
+			}
+		}
+#ifdef SHARPPHYSICS_STATS
+		// Count the lanes' rejections as Circle::TimeUntilCollide would have.
+		for (size_t l = 0; l < lane_count; l++) {
+			SHARPPHYSICS_STATS_SCOPE(&lanes[l]->stats);
+			SHARPPHYSICS_COUNT_N(PairChecks, rejections[l]);
+			SHARPPHYSICS_COUNT_N(SweptRejections, rejections[l]);
+			SHARPPHYSICS_COUNT_N(BoundsRejections, rejections[l]);
+			rejections[l] = 0;
+		}
+#endif
+	}
+
+	void Ensemble::PositionsAt(Timestamp t, BodyID id, std::vector<spf> *xs, std::vector<spf> *ys) {
+		xs->resize(variants.size());
+		ys->resize(variants.size());
+		for (size_t i = 0; i < variants.size(); i++) {
+			auto at = variants[i]->At(t);
+			Point2d p = at.second->GetBody(id)->PositionAfterDuration(at.first);
+			(*xs)[i] = p.x;
+			(*ys)[i] = p.y;
+		}
+	}
+}
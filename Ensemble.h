@@ -0,0 +1,137 @@
+#ifndef __SHARPPHYSICS_ENSEMBLE_H_
+#define __SHARPPHYSICS_ENSEMBLE_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Math.h"
+#include "System.h"
+
+namespace SharpPhysics {
+	// An Ensemble runs many variants of one scene side by side, eg. the same
+	// table under different cue shots, for shot searches or analytics.
+	//
+	// Each variant starts from the base System's latest snapshot, so the
+	// timeline up to there is only calculated once, and shares the base's
+	// fixtures and BodyInfo rather than copying them. Variants are stepped
+	// together: each round, every variant that needs it creates its next
+	// snapshot, then their collision searches run as one, with the bodies of
+	// each variant laid out as a lane of per-body arrays. Each pair's swept
+	// bounding box test runs across all its lanes at once, without branching,
+	// and only the lanes it doesn't rule out go on to
+	// Circle::TimeUntilCollide. A variant whose bodies no longer line up with
+	// the others' (eg. an input added a body) has diverged, and is searched
+	// on its own. Each variant still follows its own sequence of events, so
+	// its results are bit for bit those of running it alone from the same
+	// scene with the same inputs.
+	//
+	// With SHARPPHYSICS_STATS, each variant's stats count as usual, except
+	// that CalculatePhase isn't timed, as the variants calculate together.
+	class Ensemble {
+	public:
+		// base must be calculated (ie. have its first snapshot and have had
+		// Calculate called), must outlive the Ensemble, and must not be
+		// rewound before its latest snapshot while the Ensemble exists.
+		explicit Ensemble(System *base);
+
+		// AddVariant adds a variant starting from the base's latest snapshot,
+		// with the base's pending inputs (and their keys), settings and
+		// trigger subscriptions, and returns its index. The subscriptions'
+		// funcs are shared, so each is called with the events of every
+		// variant; use Variant(i)->SubscribeTrigger to tell variants apart.
+		// Add the variant's own inputs with Variant(i)->AddInputEvent etc;
+		// they must be later than that snapshot.
+		size_t AddVariant();
+		System *Variant(size_t i) { return variants[i].get(); }
+		size_t Size() const { return variants.size(); }
+
+		// CalculateToTime advances every variant to time t, as
+		// System::CalculateToTime.
+		void CalculateToTime(Timestamp t);
+
+		// CalculateToRest advances every variant until it comes to rest (or
+		// 'deadline'), as System::CalculateToRest, and returns the times at
+		// which they did, by variant.
+		std::vector<Timestamp> CalculateToRest(Timestamp deadline = Infinity);
+
+		// PositionsAt sets xs[i] and ys[i] to the position of body id at time
+		// t in variant i, laid out by variant so that per-body analytics can
+		// run across all the variants at once. Every variant must have been
+		// calculated to t.
+		void PositionsAt(Timestamp t, BodyID id, std::vector<spf> *xs, std::vector<spf> *ys);
+
+	private:
+		System *base;
+		std::vector<std::unique_ptr<System>> variants;
+
+		// StepWhile steps the variants for which should_step is true, a round
+		// at a time, until it's false for all of them.
+		void StepWhile(const std::function<bool(const System &)> &should_step);
+		// Calculate is System::Calculate for each of 'stepped'.
+		void Calculate(const std::vector<System *> &stepped);
+		// InStep returns true if ss has the same bodies as ref, in the same
+		// order, so their states can share lanes.
+		static bool InStep(const Snapshot &ref, const Snapshot &ss);
+		// Gather lays out the latest snapshots of 'lanes' in the arrays below.
+		void Gather();
+		// FindCollisions is System::FindCollisions for each lane that's still
+		// searching.
+		void FindCollisions();
+		// Sweep sets the swept path of the body at index i, and its bounds,
+		// for the given maxtime.
+		void Sweep(size_t i, Duration maxtime);
+		// UpdateMaxtime brings lane l's maxtime up to date with its search,
+		// and if that changed it, sweeps the lane's moving bodies again, so
+		// the paths and bounds are always those for the lane's maxtime.
+		void UpdateMaxtime(size_t l);
+		SegBounds BoundsAt(size_t i) const;
+		// RejectLanes sets rejected[l], for lanes 'from' up to 'to', to the
+		// bounding box test of Circle::TimeUntilCollide for bodies k and j
+		// (by their bounds; see 'bounded'). RejectFixtureLanes is that for
+		// body k and Line fixture f. Neither branches, so the test runs
+		// across the lanes at once.
+		void RejectLanes(size_t k, size_t j, size_t from, size_t to, spf dist_squared);
+		void RejectFixtureLanes(size_t k, size_t f, size_t from, size_t to, spf dist_squared);
+		// SweptApart is that test for the bodies at i and other in lane l,
+		// taken from the mask if 'masked', and FixtureSweptApart is that for
+		// the body at i and Line fixture f.
+		bool SweptApart(size_t i, size_t other, size_t l, bool masked, spf dist_squared) const;
+		bool FixtureSweptApart(size_t i, size_t f, size_t l, bool masked, spf dist_squared) const;
+
+		// The variants whose collisions are being searched together, and, by
+		// lane, where each is in its search.
+		std::vector<System *> lanes;
+		std::vector<System::CollisionSearch> searches;
+		std::vector<Timestamp> times;  // Of the latest snapshot.
+		std::vector<Duration> maxtimes;  // The window or the horizon, whichever is sooner.
+		std::vector<char> searching;  // The lane mask; false once a lane's collisions are final.
+		std::vector<size_t> active;  // FindCollisions' lanes for the current body.
+		// RejectLanes' mask for the current pair, 1 where it's ruled out; spf
+		// rather than char, as mixing widths keeps compilers from vectorizing.
+		std::vector<spf> rejected;
+#ifdef SHARPPHYSICS_STATS
+		std::vector<uint64_t> rejections;  // Pair checks ruled out across lanes.
+#endif
+
+		// The bodies' state, by body then lane, so body k of lane l is at
+		// [k * lanes.size() + l], and body k's lanes are contiguous.
+		std::vector<const Body *> bodies;
+		std::vector<char> moving;
+		std::vector<LineSeg> paths;
+		// The bounds of each path, field by field, and whether they can stand
+		// in for it.
+		std::vector<spf> min_x, max_x, min_y, max_y, magnitude;
+		std::vector<char> bounded;
+		// By body, the same in every lane.
+		std::vector<char> circles;
+		std::vector<spf> radii;
+		// By fixture, whether it's a Line, and if so its segment.
+		std::vector<char> fixture_lines;
+		std::vector<LineSeg> fixture_segs;
+		std::vector<SegBounds> fixture_bounds;
+		std::vector<char> fixture_bounded;
+	};
+}
+
+#endif // __SHARPPHYSICS_ENSEMBLE_H_
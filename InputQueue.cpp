@@ -0,0 +1,40 @@
+#include <algorithm>
+#include <iterator>
+#include "InputQueue.h"
+
+namespace SharpPhysics {
+	ConcurrentInputQueue::~ConcurrentInputQueue() {
+		Drain();
+	}
+
+	void ConcurrentInputQueue::Push(Timestamp t, Action action, InputKey key) {
+		std::uint64_t sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+		Node *node = new Node{ Input{ t, sequence, std::move(action), key }, head.load(std::memory_order_relaxed) };
+		while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {}
+	}
+
+	std::vector<ConcurrentInputQueue::Input> ConcurrentInputQueue::Drain() {
+		Node *node = head.exchange(nullptr, std::memory_order_acquire);
+		while (node) {
+			held.push_back(std::move(node->input));
+			Node *next = node->next;
+			delete node;
+			node = next;
+		}
+		// A producer numbers its input before pushing it, so one with a lower
+		// number can still be on its way; only return the inputs numbered
+		// before the first gap, and hold the rest until it's filled.
+		std::sort(held.begin(), held.end(), [](const Input &a, const Input &b) { return a.sequence < b.sequence; });
+		size_t ready = 0;
+		while (ready < held.size() && held[ready].sequence == next_drained + ready) {
+			ready++;
+		}
+		std::vector<Input> inputs(std::make_move_iterator(held.begin()), std::make_move_iterator(held.begin() + ready));
+		held.erase(held.begin(), held.begin() + ready);
+		next_drained += ready;
+		std::sort(inputs.begin(), inputs.end(), [](const Input &a, const Input &b) {
+			return a.t < b.t || (a.t == b.t && a.sequence < b.sequence);
+		});
+		return inputs;
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef __SHARPPHYSICS_INPUTQUEUE_H_
+#define __SHARPPHYSICS_INPUTQUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "Base.h"
+
+namespace SharpPhysics {
+	class Snapshot;
+
+	// An Action is typically a lambda that operates on a snapshot, eg.
+	// one possible Action might be [body_id](Snapshot *ss) {
+	//   ss->GetBody(body_id)->Stop();
+	// }
+	// This action would cause the body identified by body_id to stop,
+	// in the snapshot on which it is called (usually a newly created
+	// snapshot).
+	typedef std::function<void(Snapshot *ss)> Action;
+
+	// An InputKey identifies an input event by what it does, so that a
+	// System can recognise the same set of inputs coming round again (see
+	// System::branch_cache_size). Equal keys must mean equal Actions.
+	typedef std::uint64_t InputKey;
+	static const InputKey Unkeyed = 0;
+
+	// A ConcurrentInputQueue lets any number of threads submit timestamped
+	// Actions without locking, for a single consumer thread to drain. Each
+	// submission is numbered as it arrives, and drains hand inputs out in
+	// that order: a drain never returns an input numbered before one an
+	// earlier drain returned. Each drain's inputs are ordered by timestamp
+	// then number, so inputs queued at the same timestamp end up in
+	// submission order however the drains interleave with the producers.
+	class ConcurrentInputQueue {
+	public:
+		struct Input {
+			Timestamp t;
+			std::uint64_t sequence;
+			Action action;
+			InputKey key;
+		};
+
+		ConcurrentInputQueue() : head(nullptr), next_sequence(0), next_drained(0) {}
+		~ConcurrentInputQueue();
+		ConcurrentInputQueue(const ConcurrentInputQueue &) = delete;
+		ConcurrentInputQueue &operator=(const ConcurrentInputQueue &) = delete;
+
+		// Push may be called from any thread.
+		void Push(Timestamp t, Action action, InputKey key = Unkeyed);
+
+		// Empty and Drain are for the consumer thread only. Drain removes and
+		// returns everything pushed so far, ordered by timestamp then sequence,
+		// except that inputs numbered after one that's still being pushed are
+		// held back for a later drain, so Drain may return nothing. Empty is
+		// true if nothing's been pushed since the last drain.
+		bool Empty() const { return head.load(std::memory_order_acquire) == nullptr; }
+		std::vector<Input> Drain();
+
+	private:
+		// Producers push onto a lock-free stack; the consumer takes the whole
+		// stack at once, which sidesteps the ABA problem of popping nodes.
+		struct Node {
+			Input input;
+			Node *next;
+		};
+		std::atomic<Node *> head;
+		std::atomic<std::uint64_t> next_sequence;
+		// The consumer's: inputs held back by Drain, and the next sequence
+		// number it will return.
+		std::vector<Input> held;
+		std::uint64_t next_drained;
+	};
+}
+
+#endif // __SHARPPHYSICS_INPUTQUEUE_H_
@@ -1,7 +1,9 @@
 #include <algorithm>
+#include <limits>
 #include "Base.h"
 #include "math.h"
 #include "poly.h"
+#include "Stats.h"
 
 namespace SharpPhysics {
 	const Vec2d Vec2d::Zero{ 0.0, 0.0 };
@@ -27,7 +29,7 @@ namespace SharpPhysics {
 			// Line is a point, return point distance.
 			return (l.a - p).SqrMagnitude();
 		}
-		spf t = ((p.x - l.a.x) * ld.x + (p.y - l.a.y) * ld.y) / (ld.x * ld.x + ld.y * ld.y);
+		spf t = Vec2d::Dot(p - l.a, ld) / ld.SqrMagnitude();
 		if (t < 0)
 		{
 			// Point is closest to l.a.
@@ -38,56 +40,117 @@ namespace SharpPhysics {
 			// Point is closest to l.b.
 			return (l.b - p).SqrMagnitude();
 		}
-		Vec2d near{ l.a.x + t * ld.x, l.a.y + t * ld.y };
+		Vec2d near{ MulAdd(t, ld.x, l.a.x), MulAdd(t, ld.y, l.a.y) };
 		return (near - p).SqrMagnitude();
 	}
 
 	bool LineSegsIntersect(const LineSeg &l1, const LineSeg &l2)
 	{
+		// l1.a + s*l1d == l2.a + t*l2d, solved by Cramer's rule.
 		Vec2d l1d = l1.GetDelta();
 		Vec2d l2d = l2.GetDelta();
-		spf delta = l2d.x * l1d.y - l2d.y * l1d.x;
+		spf delta = MulAdd(l1d.x, l2d.y, -(l1d.y * l2d.x));
 		if (delta == 0) { return false; }  // parallel
-		spf s = (l1d.x * (l2.a.y - l1.a.y) + l1d.y * (l1.a.x - l1.a.x)) / delta;
-		spf t = (l2d.x * (l1.a.y - l2.a.y) + l2d.y * (l2.a.x - l2.a.x)) / (-delta);
+		Vec2d w = l2.a - l1.a;
+		spf s = MulAdd(w.x, l2d.y, -(w.y * l2d.x)) / delta;
+		spf t = MulAdd(w.x, l1d.y, -(w.y * l1d.x)) / delta;
 		return (0 <= s && s <= 1) && (0 <= t && t <= 1);
 	}
 
+	bool LineSegsFartherThan(const LineSeg &l1, const LineSeg &l2, spf dist_squared)
+	{
+		if (BoundsFartherThan(l1, l2, dist_squared)) {
+			SHARPPHYSICS_COUNT(BoundsRejections);
+			return true;
+		}
+		// A path off to infinity (or NaN) can't be ruled out.
+		if (!std::isfinite(l1.a.x + l1.a.y + l1.b.x + l1.b.y + l2.a.x + l2.a.y + l2.b.x + l2.b.y)) return false;
+		return LineSegsDistanceSquared(l1, l2) > dist_squared;
+	}
+
+	void ApproachQuartic(const Vec2d &relpos, const Vec2d &relvel, const Vec2d &relaccel, spf dist_squared, spf coef[5]) {
+		// DistAtTime = relpos + relvel * t + relaccel * t^2 / 2;
+		// xt = rpx + rvx*t + rax/2*t^2;
+		// yt = rpy + rvy*t + ray/2*t^2;
+		// touching when xt^2 + yt^2 = dist_squared
+		// xt^2 = rpx^2 + rpx*rvx*2*t + rpx*rax*t^2 + rvx^2*t^2 + rvx*rax*t^3 + rax^2/4*t^4;
+		// (rax^2/4)t^4 + (rvx*rax)t^3 + (rvx^2 + rpx*rax)t^2 + (rpx*rvx*2)t + rpx^2
+		// Touching when at^4 + bt^3 + ct^2 + dt + e = 0
+		coef[0] = relaccel.SqrMagnitude() / 4;
+		coef[1] = Vec2d::Dot(relvel, relaccel);
+		coef[2] = relvel.SqrMagnitude() + Vec2d::Dot(relpos, relaccel);
+		coef[3] = Vec2d::Dot(relpos, relvel) * 2;
+		coef[4] = relpos.SqrMagnitude() - dist_squared;
+	}
+
 	spf SolveQuartic(spf a, spf b, spf c, spf d, spf e, bool only_inward)
 	{
+#ifndef SHARPPHYSICS_REFERENCE_PREDICATES
+		// With no sign changes in the gradient's coefficients, the gradient is
+		// positive for every t > 0 (even as rounded, being a sum of
+		// non-negative terms), so every root would be discarded below.
+		if (only_inward && a >= 0 && b >= 0 && c >= 0 && d > 0) {
+			SHARPPHYSICS_COUNT(SignRejections);
+			return NaN;
+		}
+#endif
 		double root[4];
-		int n;
+		int real;  // The number of real roots, at the start of root.
 		if (a == 0) {
-			n = Poly::SolveP3(root, c / b, d / b, e / b);
+			if (b == 0) return SolveQuadratic(c, d, e, only_inward);
+			SHARPPHYSICS_COUNT(CubicSolves);
+			int n = Poly::SolveP3(root, c / b, d / b, e / b);
+			// With n == 1, root[1] and root[2] are a complex pair.
+			real = n;
 		}
 		else {
-			n = Poly::SolveP4(root, b / a, c / a, d / a, e / a);
+			SHARPPHYSICS_COUNT(QuarticSolves);
+			// 0, 2 or 4; with 2, root[2] and root[3] are a complex pair.
+			real = Poly::SolveP4(root, b / a, c / a, d / a, e / a);
 		}
-		if (n == 0) return NaN;
 		auto InvalidateBadRoot = [=](double t) {
 			if (t <= 0) return NaN;  // We don't care about collisions backwards in time!
 			if (only_inward) {
-				double grade = a * 4 * std::pow(t, 3) + b * 3 * std::pow(t, 2) + c * 2 * t + d;
+				double grade = MulAdd(MulAdd(MulAdd(a * 4, t, b * 3), t, c * 2), t, d);
 				if (grade > 0) return NaN;  // They're moving apart, don't collide.
 			}
 			return t;
 		};
-		double best = std::min(InvalidateBadRoot(root[0]), InvalidateBadRoot(root[1]));
-		if (n == 4) best = std::min(best, std::min(InvalidateBadRoot(root[2]), InvalidateBadRoot(root[3])));
+		// fmin rather than min, so an invalidated (NaN) root doesn't hide a valid one.
+		double best = NaN;
+		for (int i = 0; i < real; i++) {
+			best = std::fmin(best, InvalidateBadRoot(root[i]));
+		}
 		return best;
 	}
 
 	spf SolveQuadratic(spf a, spf b, spf c, bool only_inward) {
-		spf t1 = (-b + std::sqrt(b*b - 4 * a*c)) / (4 * a*a);
-		spf t2 = (-b - std::sqrt(b*b - 4 * a*c)) / (4 * a*a);
+#ifndef SHARPPHYSICS_REFERENCE_PREDICATES
+		// As in SolveQuartic, every root would be moving apart.
+		if (only_inward && a >= 0 && b > 0) {
+			SHARPPHYSICS_COUNT(SignRejections);
+			return NaN;
+		}
+#endif
+		SHARPPHYSICS_COUNT(QuadraticSolves);
 		auto InvalidateBadRoot = [=](spf t) {
 			if (t <= 0) return NaN; // No collisions backwards in time.
 			if (only_inward) {
-				double grade = a * 2 * t + b;
+				double grade = MulAdd(a * 2, t, b);
 				if (grade > 0) return NaN;  // They're moving apart, don't collide.
 			}
 			return t;
 		};
-		return std::min(InvalidateBadRoot(t1), InvalidateBadRoot(t2));
+		if (a == 0) {
+			// No acceleration, so it's linear.
+			if (b == 0) return NaN;
+			return InvalidateBadRoot(-c / b);
+		}
+		spf discriminant = MulAdd(b, b, -(4 * a*c));
+		if (discriminant < 0) return NaN;
+		spf t1 = (-b + std::sqrt(discriminant)) / (2 * a);
+		spf t2 = (-b - std::sqrt(discriminant)) / (2 * a);
+		// fmin rather than min, so an invalidated (NaN) root doesn't hide a valid one.
+		return std::fmin(InvalidateBadRoot(t1), InvalidateBadRoot(t2));
 	}
 }
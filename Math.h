@@ -1,6 +1,7 @@
 #ifndef __SHARPPHYSICS_MATH_H_
 #define __SHARPPHYSICS_MATH_H_
 
+#include <algorithm>
 #include "Base.h"
 
 namespace SharpPhysics {
@@ -14,6 +15,70 @@ namespace SharpPhysics {
 	// Returns true if two line segments intersect.
 	bool LineSegsIntersect(const LineSeg &l1, const LineSeg &l2);
 
+	// Returns true if two line segments are more than sqrt(dist_squared)
+	// apart, ie. LineSegsDistanceSquared(l1, l2) > dist_squared, or false if
+	// any coordinate isn't finite. Clearly separated segments are rejected by
+	// their bounding boxes first.
+	//
+	// This and the solvers below skip work with such filters, which only
+	// decide cases whose exact result is certain, so results are identical
+	// with or without them; defining SHARPPHYSICS_REFERENCE_PREDICATES turns
+	// them off, to check that.
+	bool LineSegsFartherThan(const LineSeg &l1, const LineSeg &l2, spf dist_squared);
+
+	// SegBounds is a segment's bounding box and the largest magnitude of its
+	// coordinates, as BoundsFartherThan uses them.
+	struct SegBounds {
+		spf min_x, max_x, min_y, max_y;
+		spf magnitude;
+	};
+	inline SegBounds BoundsOf(const LineSeg &l)
+	{
+		return SegBounds{ std::min(l.a.x, l.b.x), std::max(l.a.x, l.b.x), std::min(l.a.y, l.b.y), std::max(l.a.y, l.b.y),
+			std::max(std::max(std::abs(l.a.x), std::abs(l.a.y)), std::max(std::abs(l.b.x), std::abs(l.b.y))) };
+	}
+
+	// BoundsFartherThan is LineSegsFartherThan's bounding box test: it
+	// returns true if the boxes alone show the segments are more than
+	// sqrt(dist_squared) apart, and false if they don't, or any coordinate
+	// isn't finite. The SegBounds version is for bounds worked out ahead, of
+	// segments whose coordinates are known to add up to a finite number.
+	// They're inline so that Ensemble, which runs them across its variants,
+	// gets exactly the same answers.
+	inline bool BoundsFartherThan(const SegBounds &b1, const SegBounds &b2, spf dist_squared)
+	{
+#ifdef SHARPPHYSICS_REFERENCE_PREDICATES
+		return false;
+#else
+		// The segments are at least as far apart as their bounding boxes. If
+		// the boxes are clearly farther apart than the rounding error of
+		// LineSegsDistanceSquared (which grows with the coordinates'
+		// magnitude), it would say so too.
+		//
+		// That's max(gap_x, 0)^2 + max(gap_y, 0)^2 > limit, written without
+		// branches after the squares so that compilers can run it across
+		// Ensemble's lanes. It gives the same answer: a gap is only counted if
+		// it's positive (with neither, it's 0 against the limit), and as
+		// rounding is monotonic, a sum of squares is over the limit if either
+		// square is. The maxes are spelled out as std::max's comparisons, on
+		// values rather than references.
+		spf x1 = b2.min_x - b1.max_x, x2 = b1.min_x - b2.max_x;
+		spf y1 = b2.min_y - b1.max_y, y2 = b1.min_y - b2.max_y;
+		spf gap_x = x1 < x2 ? x2 : x1;
+		spf gap_y = y1 < y2 ? y2 : y1;
+		spf magnitude = b1.magnitude < b2.magnitude ? b2.magnitude : b1.magnitude;
+		spf limit = dist_squared + 64 * std::numeric_limits<spf>::epsilon() * (magnitude * magnitude + dist_squared);
+		spf square_x = gap_x * gap_x, square_y = gap_y * gap_y;
+		bool apart_x = gap_x > 0, apart_y = gap_y > 0;
+		return (apart_x & apart_y & (square_x + square_y > limit)) | (apart_x & (square_x > limit)) | (apart_y & (square_y > limit)) | (limit < 0);
+#endif
+	}
+	inline bool BoundsFartherThan(const LineSeg &l1, const LineSeg &l2, spf dist_squared)
+	{
+		if (!std::isfinite(l1.a.x + l1.a.y + l1.b.x + l1.b.y + l2.a.x + l2.a.y + l2.b.x + l2.b.y)) return false;
+		return BoundsFartherThan(BoundsOf(l1), BoundsOf(l2), dist_squared);
+	}
+
 	// Solves a quartic equation as used to determine the time of
 	// collision between two moving, accelerating objects (or more
 	// specifically, the time at which distance == radius+other_radius
@@ -22,9 +87,16 @@ namespace SharpPhysics {
 	// discarded, and if only_inward is true, any roots where the delta
 	// is positive (which means the objects are actually moving apart)
 	// are discarded. The smallest surviving root is returned, or, if
-	// no roots remain, NaN is returned.
+	// no roots remain, NaN is returned. Leading zero coefficients are
+	// allowed, and solved as a cubic or quadratic instead.
 	spf SolveQuartic(spf a, spf b, spf c, spf d, spf e, bool only_inward);
 
+	// Sets coef[0..4] to a..e of the quartic at^4 + bt^3 + ct^2 + dt + e
+	// whose roots are the times at which two points are sqrt(dist_squared)
+	// apart, given their relative position, velocity and (constant)
+	// acceleration. e is negative if they're already closer than that.
+	void ApproachQuartic(const Vec2d &relpos, const Vec2d &relvel, const Vec2d &relaccel, spf dist_squared, spf coef[5]);
+
 	// Same as SolveQuartic but simpler.
 	spf SolveQuadratic(spf a, spf b, spf c, bool only_inward);
 }
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include "Query.h"
+#include "System.h"
+
+namespace SharpPhysics {
+	// Bodies whose path covers more cells than this (or whose cells don't
+	// fit a Key) go in the unbounded list instead, so one fast body can't
+	// bloat the grid.
+	static const int max_cells_per_body = 256;
+
+	bool PathBounds(const Body &body, Duration d, Point2d *lo, Point2d *hi) {
+		Point2d start = body.Position();
+		Point2d end = body.PathEndAfterDuration(d);
+		if (!std::isfinite(end.x) || !std::isfinite(end.y)) return false;
+		*lo = Point2d{ std::min(start.x, end.x), std::min(start.y, end.y) };
+		*hi = Point2d{ std::max(start.x, end.x), std::max(start.y, end.y) };
+		return !std::isnan(lo->x) && !std::isnan(lo->y);
+	}
+
+	SpatialGrid::SpatialGrid(const Snapshot &ss, Duration s, spf cs) : span(s), cell_size(cs), lo{ Infinity, Infinity }, hi{ -Infinity, -Infinity } {
+		for (const auto &b : ss.bodies) {
+			Body *body = b.second.get();
+			Point2d blo, bhi;
+			if (!PathBounds(*body, span, &blo, &bhi)) {
+				unbounded.push_back(body);
+				continue;
+			}
+			Coord x0 = CellOf(blo.x), x1 = CellOf(bhi.x), y0 = CellOf(blo.y), y1 = CellOf(bhi.y);
+			bool in_range = x0 >= INT32_MIN && x1 <= INT32_MAX && y0 >= INT32_MIN && y1 <= INT32_MAX;
+			if (!in_range || (x1 - x0 + 1) * (y1 - y0 + 1) > max_cells_per_body) {
+				unbounded.push_back(body);
+				continue;
+			}
+			for (Coord x = x0; x <= x1; x++) {
+				for (Coord y = y0; y <= y1; y++) {
+					cells[Key(x, y)].push_back(body);
+				}
+			}
+			lo = Point2d{ std::min(lo.x, blo.x), std::min(lo.y, blo.y) };
+			hi = Point2d{ std::max(hi.x, bhi.x), std::max(hi.y, bhi.y) };
+		}
+	}
+
+	void SpatialGrid::ForEachCandidate(const Point2d &p, spf r, const std::function<void(Body *body)> &func) const {
+		for (Body *body : unbounded) {
+			func(body);
+		}
+		if (cells.empty()) return;
+		// Clamp the query box to the grid's bounds, so a huge r doesn't visit
+		// lots of empty cells.
+		Coord x0 = CellOf(std::max(p.x - r, lo.x)), x1 = CellOf(std::min(p.x + r, hi.x));
+		Coord y0 = CellOf(std::max(p.y - r, lo.y)), y1 = CellOf(std::min(p.y + r, hi.y));
+		if (x1 < x0 || y1 < y0) return;
+		if (spf(x1 - x0 + 1) * spf(y1 - y0 + 1) > spf(cells.size())) {
+			// Cheaper to walk the occupied cells than the query's box.
+			for (const auto &cell : cells) {
+				Coord x = Coord(std::int32_t(cell.first >> 32)), y = Coord(std::int32_t(cell.first & 0xffffffff));
+				if (x < x0 || x > x1 || y < y0 || y > y1) continue;
+				for (Body *body : cell.second) func(body);
+			}
+			return;
+		}
+		for (Coord x = x0; x <= x1; x++) {
+			for (Coord y = y0; y <= y1; y++) {
+				auto cell = cells.find(Key(x, y));
+				if (cell == cells.end()) continue;
+				for (Body *body : cell->second) func(body);
+			}
+		}
+	}
+
+	spf SpatialGrid::Reach(const Point2d &p) const {
+		if (cells.empty()) return 0;
+		spf dx = std::max(std::abs(p.x - lo.x), std::abs(p.x - hi.x));
+		spf dy = std::max(std::abs(p.y - lo.y), std::abs(p.y - hi.y));
+		return std::sqrt(dx * dx + dy * dy);
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef __SHARPPHYSICS_QUERY_H_
+#define __SHARPPHYSICS_QUERY_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "Body.h"
+
+namespace SharpPhysics {
+	class Snapshot;
+
+	// A SpatialGrid buckets the bodies of one Snapshot into square cells by
+	// the path each body's center covers over the following 'span' of time,
+	// so a spatial query at any time in that span only needs to look at the
+	// bodies in nearby cells. Bodies whose path is unbounded (frictionless
+	// bodies with no later snapshot) or very long are kept in a separate list
+	// and are candidates for every query.
+	class SpatialGrid {
+	public:
+		SpatialGrid(const Snapshot &ss, Duration span, spf cell_size);
+
+		Duration Span() const { return span; }
+		spf CellSize() const { return cell_size; }
+
+		// ForEachCandidate calls func for every body that might be within r of
+		// p at some time in the span. A body may be passed more than once, and
+		// bodies that turn out to be further away may be passed too.
+		void ForEachCandidate(const Point2d &p, spf r, const std::function<void(Body *body)> &func) const;
+
+		// Reach returns a distance from p within which every bounded body in
+		// the grid lies, for the whole span.
+		spf Reach(const Point2d &p) const;
+
+	private:
+		typedef std::int64_t Coord;
+		static std::uint64_t Key(Coord x, Coord y) { return (std::uint64_t(std::uint32_t(x)) << 32) | std::uint32_t(y); }
+		// Clamped so far-off values still convert safely; they're out of Key's range either way.
+		Coord CellOf(spf v) const { return Coord(std::max(-4e18, std::min(4e18, std::floor(v / cell_size)))); }
+
+		Duration span;
+		spf cell_size;
+		std::unordered_map<std::uint64_t, std::vector<Body *>> cells;
+		std::vector<Body *> unbounded;
+		Point2d lo, hi;  // Bounds of all bounded paths.
+	};
+
+	// PathBounds sets lo and hi to the axis-aligned box covered by body's
+	// center over the next d, which is the box around its start and end
+	// points, since friction only ever acts against the direction of travel.
+	// Returns false if the path is unbounded.
+	bool PathBounds(const Body &body, Duration d, Point2d *lo, Point2d *hi);
+}
+
+#endif // __SHARPPHYSICS_QUERY_H_
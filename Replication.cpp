@@ -0,0 +1,201 @@
+#include <cstdint>
+#include <cstring>
+#include "Replication.h"
+
+namespace SharpPhysics {
+	// Record layout, all numbers little-endian:
+	//   kind (1 byte), timestamp (8 byte double), then for transitions the
+	//   duration (8 byte double), and for transitions and keyframes a body
+	//   count (varint) followed by that many bodies:
+	//     BodyID (zigzag varint), flags (1 byte),
+	//     velocity (2 doubles) unless stopped, position (2 doubles) if HasPosition.
+	static const char TransitionRecord = 'T';
+	static const char KeyframeRecord = 'K';
+	static const char RewindRecord = 'R';
+	static const std::uint8_t Stopped = 1;
+	static const std::uint8_t HasPosition = 2;
+
+	static void PutVarint(std::string *out, std::uint64_t v) {
+		while (v >= 0x80) {
+			out->push_back(char((v & 0x7f) | 0x80));
+			v >>= 7;
+		}
+		out->push_back(char(v));
+	}
+
+	static void PutDouble(std::string *out, double d) {
+		std::uint64_t bits;
+		std::memcpy(&bits, &d, sizeof(bits));
+		for (int i = 0; i < 8; i++) {
+			out->push_back(char(bits >> (i * 8)));
+		}
+	}
+
+	static void PutBody(std::string *out, const Body &body, bool with_position) {
+		std::int64_t id = body.ID;
+		PutVarint(out, (std::uint64_t(id) << 1) ^ std::uint64_t(id >> 63));
+		std::uint8_t flags = (body.IsStopped() ? Stopped : 0) | (with_position ? HasPosition : 0);
+		out->push_back(char(flags));
+		if (!body.IsStopped()) {
+			PutDouble(out, body.Velocity().x);
+			PutDouble(out, body.Velocity().y);
+		}
+		if (with_position) {
+			PutDouble(out, body.Position().x);
+			PutDouble(out, body.Position().y);
+		}
+	}
+
+	// Reader consumes a record, throwing if it runs out.
+	class Reader {
+	public:
+		explicit Reader(const std::string &s) : data(s), pos(0) {}
+		std::uint8_t Byte() {
+			if (pos >= data.size()) throw "Truncated replication record";
+			return std::uint8_t(data[pos++]);
+		}
+		std::uint64_t Varint() {
+			std::uint64_t v = 0;
+			for (int shift = 0; shift < 64; shift += 7) {
+				std::uint8_t b = Byte();
+				v |= std::uint64_t(b & 0x7f) << shift;
+				if (!(b & 0x80)) return v;
+			}
+			throw "Malformed replication record";
+		}
+		double Double() {
+			std::uint64_t bits = 0;
+			for (int i = 0; i < 8; i++) {
+				bits |= std::uint64_t(Byte()) << (i * 8);
+			}
+			double d;
+			std::memcpy(&d, &bits, sizeof(d));
+			return d;
+		}
+		BodyID ID() {
+			std::uint64_t z = Varint();
+			return BodyID(std::int64_t(z >> 1) ^ -std::int64_t(z & 1));
+		}
+		bool Done() const { return pos == data.size(); }
+	private:
+		const std::string &data;
+		size_t pos;
+	};
+
+	std::string EncodeTransition(Timestamp ts, Duration d, const Snapshot &prev, const Snapshot &ss) {
+		std::string out;
+		out.push_back(TransitionRecord);
+		PutDouble(&out, ts);
+		PutDouble(&out, d);
+		// A body changed if its state differs from simply carrying the previous
+		// snapshot's motion forward, which is what FillFromPrevious did.
+		std::vector<std::pair<const Body *, bool>> changed;
+		for (const auto &b : ss.bodies) {
+			auto before = prev.bodies.find(b.first);
+			if (before == prev.bodies.end()) continue;
+			const Body &was = *before->second;
+			const Body &now = *b.second;
+			Vec2d expected = was.VelocityAfterDuration(d);
+			// Lines aren't moved by FillFromPrevious.
+			Point2d expected_pos = was.GetType() == Circle::Type ? was.PositionAfterDuration(d) : was.Position();
+			bool moved = now.Position().x != expected_pos.x || now.Position().y != expected_pos.y;
+			if (moved || now.IsStopped() != was.IsStopped() || (!now.IsStopped() && (now.Velocity().x != expected.x || now.Velocity().y != expected.y))) {
+				changed.emplace_back(&now, moved);
+			}
+		}
+		PutVarint(&out, changed.size());
+		for (const auto &body : changed) {
+			PutBody(&out, *body.first, body.second);
+		}
+		return out;
+	}
+
+	std::string EncodeKeyframe(Timestamp ts, const Snapshot &ss) {
+		std::string out;
+		out.push_back(KeyframeRecord);
+		PutDouble(&out, ts);
+		PutVarint(&out, ss.bodies.size());
+		for (const auto &b : ss.bodies) {
+			PutBody(&out, *b.second, true);
+		}
+		return out;
+	}
+
+	std::string EncodeRewind(Timestamp ts) {
+		std::string out;
+		out.push_back(RewindRecord);
+		PutDouble(&out, ts);
+		return out;
+	}
+
+	void StreamTransitions(System *server, RecordFunc out) {
+		server->on_snapshot = [out](Timestamp ts, Duration d, const Snapshot &prev, const Snapshot &ss) {
+			out(EncodeTransition(ts, d, prev, ss));
+		};
+		server->on_rewind = [out](Timestamp ts) {
+			out(EncodeRewind(ts));
+		};
+	}
+
+	// ReadBodies applies the body records in r to ss.
+	static void ReadBodies(Reader *r, Snapshot *ss) {
+		std::uint64_t count = r->Varint();
+		for (std::uint64_t i = 0; i < count; i++) {
+			BodyID id = r->ID();
+			std::uint8_t flags = r->Byte();
+			auto found = ss->bodies.find(id);
+			if (found == ss->bodies.end()) throw "Replication record for unknown body";
+			Body *body = found->second.get();
+			if (flags & Stopped) {
+				body->Stop();
+			}
+			else {
+				// x then y; sequenced explicitly as older MSVC doesn't evaluate braced initializers in order.
+				Vec2d v{ r->Double(), 0 };
+				v.y = r->Double();
+				// AddVelocity to clear the stopped flag; adding to zero is exact.
+				body->SetVelocity(Vec2d::Zero);
+				body->AddVelocity(v);
+			}
+			if (flags & HasPosition) {
+				Point2d p{ r->Double(), 0 };
+				p.y = r->Double();
+				body->SetPosition(p);
+			}
+		}
+	}
+
+	void ApplyRecord(System *client, const std::string &record) {
+		Reader r(record);
+		char kind = char(r.Byte());
+		Timestamp ts = r.Double();
+		if (kind == RewindRecord) {
+			// Always keep the client's first snapshot, so there's something to
+			// fill the next snapshot from.
+			if (ts > client->snapshots.begin()->first) client->DiscardFromTime(ts);
+		}
+		else if (kind == TransitionRecord) {
+			Duration d = r.Double();
+			auto last = std::prev(client->snapshots.cend());
+			if (!(ts > last->first)) throw "Replication record out of order";
+			std::unique_ptr<Snapshot> ss(new Snapshot());
+			ss->FillFromPrevious(*last->second, d);
+			ReadBodies(&r, ss.get());
+			client->InsertSnapshot(ts, std::move(ss));
+		}
+		else if (kind == KeyframeRecord) {
+			// Copy the bodies from the latest snapshot at or before ts (or the
+			// first), then overwrite their whole state.
+			auto base = client->snapshots.upper_bound(ts);
+			if (base != client->snapshots.begin()) base--;
+			std::unique_ptr<Snapshot> ss(new Snapshot());
+			ss->FillFromPrevious(*base->second, 0);
+			ReadBodies(&r, ss.get());
+			client->InsertSnapshot(ts, std::move(ss));
+		}
+		else {
+			throw "Unknown replication record";
+		}
+		if (!r.Done()) throw "Malformed replication record";
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef __SHARPPHYSICS_REPLICATION_H_
+#define __SHARPPHYSICS_REPLICATION_H_
+
+#include <functional>
+#include <string>
+#include "System.h"
+
+namespace SharpPhysics {
+	// Since motion between snapshots is analytic, a client can rebuild a
+	// server's timeline from just the changes made at each transition. The
+	// functions here encode those changes as compact binary records, and
+	// apply them to a client-side System.
+	//
+	// A record is one of:
+	//   Transition: a new snapshot at a timestamp, filled from the previous
+	//     snapshot after a duration, plus the velocity and stopped state of
+	//     only those bodies the transition changed, and their position too if
+	//     that changed (eg. an input Action re-spotting a ball).
+	//   Keyframe: a snapshot with the full state (position too) of every body,
+	//     for a client joining mid-stream.
+	//   Rewind: the timeline at and after a timestamp was discarded.
+	//
+	// Bodies are identified by BodyID; the client's System must start with
+	// the same bodies (types, radii, masses etc.) and fixtures as the
+	// server's, and clients must be built the same way as the server for the
+	// analytic motion to match bit for bit. Bodies added to a snapshot by an
+	// Action aren't replicated.
+	typedef std::function<void(const std::string &record)> RecordFunc;
+
+	// EncodeTransition returns the record for snapshot ss at ts, which was
+	// filled from prev after duration d.
+	std::string EncodeTransition(Timestamp ts, Duration d, const Snapshot &prev, const Snapshot &ss);
+
+	// EncodeKeyframe returns a record with the full state of snapshot ss at ts.
+	std::string EncodeKeyframe(Timestamp ts, const Snapshot &ss);
+
+	// EncodeRewind returns the record for discarding the timeline at and
+	// after ts.
+	std::string EncodeRewind(Timestamp ts);
+
+	// StreamTransitions sets server's on_snapshot and on_rewind so that every
+	// change to its timeline is passed to 'out' as a record.
+	void StreamTransitions(System *server, RecordFunc out);
+
+	// ApplyRecord applies a record to client. The client System should only
+	// be driven by records (and read with At, ForEachAt and the queries),
+	// not advanced with CalculateToTime. Throws on a malformed or
+	// out-of-order record.
+	void ApplyRecord(System *client, const std::string &record);
+}
+
+#endif // __SHARPPHYSICS_REPLICATION_H_
@@ -0,0 +1,66 @@
+#include <algorithm>
+#include "Scene.h"
+
+namespace SharpPhysics {
+	// ByID returns pointers to defs, sorted by ID.
+	template <typename Def>
+	static std::vector<const Def *> ByID(const std::vector<Def> &defs) {
+		std::vector<const Def *> sorted;
+		sorted.reserve(defs.size());
+		for (const Def &def : defs) {
+			sorted.push_back(&def);
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const Def *a, const Def *b) { return a->id < b->id; });
+		return sorted;
+	}
+
+	void BuildScene(System *system, const std::vector<CircleDef> &circles, const std::vector<LineDef> &lines, Timestamp t) {
+		if (!system->snapshots.empty() || !system->fixtures.bodies.empty() || !system->body_info.empty()) {
+			throw "BuildScene needs an empty System";
+		}
+		auto sorted_circles = ByID(circles);
+		auto sorted_lines = ByID(lines);
+
+		// Merge the two by ID, checking for duplicates before anything is added.
+		struct Entry {
+			BodyInfo info;
+			const CircleDef *circle;
+			const LineDef *line;
+		};
+		std::vector<Entry> entries;
+		entries.reserve(circles.size() + lines.size());
+		auto c = sorted_circles.begin();
+		auto l = sorted_lines.begin();
+		while (c != sorted_circles.end() || l != sorted_lines.end()) {
+			if (l == sorted_lines.end() || (c != sorted_circles.end() && (*c)->id < (*l)->id)) {
+				entries.push_back(Entry{ BodyInfo{ (*c)->id, (*c)->extra, (*c)->friction, (*c)->mass, (*c)->radius }, *c, nullptr });
+				c++;
+			}
+			else {
+				entries.push_back(Entry{ BodyInfo{ (*l)->id, (*l)->extra, 0.0, (*l)->mass, 0.0 }, nullptr, *l });
+				l++;
+			}
+			if (entries.size() > 1 && entries[entries.size() - 2].info.id == entries.back().info.id) {
+				throw "BuildScene given a duplicate Body ID";
+			}
+		}
+
+		// Everything is in ID order, so each insertion goes at the end.
+		std::unique_ptr<Snapshot> ss(new Snapshot());
+		for (const Entry &entry : entries) {
+			BodyID id = entry.info.id;
+			const BodyInfo *info = &system->body_info.emplace_hint(system->body_info.end(), id, entry.info)->second;
+			if (entry.circle) {
+				std::unique_ptr<Body> circle(new Circle(info, entry.circle->position));
+				if (entry.circle->velocity.x != 0 || entry.circle->velocity.y != 0) circle->AddVelocity(entry.circle->velocity);
+				ss->bodies.emplace_hint(ss->bodies.end(), id, std::move(circle));
+			}
+			else {
+				std::unique_ptr<Body> line(new Line(info, entry.line->start, entry.line->end));
+				system->fixtures.bodies.emplace_hint(system->fixtures.bodies.end(), id, std::move(line));
+			}
+		}
+		system->snapshots.emplace(t, std::move(ss));
+		system->Calculate();
+	}
+}
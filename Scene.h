@@ -0,0 +1,36 @@
+#ifndef __SHARPPHYSICS_SCENE_H_
+#define __SHARPPHYSICS_SCENE_H_
+
+#include <vector>
+#include "System.h"
+
+namespace SharpPhysics {
+	// A CircleDef describes a moving body for BuildScene; a zero velocity
+	// means it starts stopped.
+	struct CircleDef {
+		BodyID id;
+		std::shared_ptr<ExtraData> extra;
+		Point2d position;
+		Vec2d velocity;
+		spf radius, friction, mass;
+	};
+
+	// A LineDef describes a fixture line for BuildScene; NaN mass makes it
+	// intangible.
+	struct LineDef {
+		BodyID id;
+		std::shared_ptr<ExtraData> extra;
+		Point2d start, end;
+		spf mass;
+	};
+
+	// BuildScene sets up an empty System in one go, for loading a level with
+	// lots of bodies: the circles go in a first snapshot at time t and the
+	// lines in the fixtures, then Calculate is called, so it's ready to run.
+	// Definitions can be in any order; they're sorted by ID so every map is
+	// filled in order rather than searched per body. Throws, leaving system
+	// untouched, if it already has snapshots or bodies, or an ID is used twice.
+	void BuildScene(System *system, const std::vector<CircleDef> &circles, const std::vector<LineDef> &lines, Timestamp t = 0);
+}
+
+#endif // __SHARPPHYSICS_SCENE_H_
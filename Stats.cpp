@@ -0,0 +1,93 @@
+#include "Stats.h"
+
+#ifdef SHARPPHYSICS_STATS
+namespace SharpPhysics {
+	static thread_local Stats *active_stats = nullptr;
+
+	void Stats::Reset() {
+		for (auto &c : counters) c = 0;
+		for (auto &p : phase_seconds) p = 0;
+		trace = false;
+		events.clear();
+		epoch = std::chrono::steady_clock::now();
+	}
+
+	const char *Stats::CounterName(Counter c) {
+		switch (c) {
+		case Calculates: return "Calculates";
+		case Snapshots: return "Snapshots";
+		case TransitionActions: return "TransitionActions";
+		case Rewinds: return "Rewinds";
+		case Reattaches: return "Reattaches";
+		case WindowWidenings: return "WindowWidenings";
+		case PairChecks: return "PairChecks";
+		case SweptRejections: return "SweptRejections";
+		case BoundsRejections: return "BoundsRejections";
+		case QuarticSolves: return "QuarticSolves";
+		case CubicSolves: return "CubicSolves";
+		case QuadraticSolves: return "QuadraticSolves";
+		case SignRejections: return "SignRejections";
+		case StaticPairs: return "StaticPairs";
+		case LinearPairs: return "LinearPairs";
+		case CollinearPairs: return "CollinearPairs";
+		case GeneralPairs: return "GeneralPairs";
+		default: return "Unknown";
+		}
+	}
+
+	const char *Stats::PhaseName(Phase p) {
+		switch (p) {
+		case CalculatePhase: return "Calculate";
+		case FillPhase: return "FillFromPrevious";
+		case ActionPhase: return "Actions";
+		default: return "Unknown";
+		}
+	}
+
+	void Stats::WriteChromeTrace(std::ostream &out) const {
+		auto old_precision = out.precision(17);
+		out << "{\"traceEvents\":[";
+		bool first = true;
+		for (const auto &e : events) {
+			if (!first) out << ",";
+			first = false;
+			out << "\n{\"name\":\"" << PhaseName(e.phase) << "\",\"cat\":\"SharpPhysics\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+				<< ",\"ts\":" << e.start_us << ",\"dur\":" << e.duration_us
+				<< ",\"args\":{\"sim_time\":" << e.sim_time << "}}";
+		}
+		// Final counter values, as a single counter sample at the end of the trace.
+		double end_us = events.empty() ? 0 : events.back().start_us + events.back().duration_us;
+		if (!first) out << ",";
+		out << "\n{\"name\":\"Counters\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":" << end_us << ",\"args\":{";
+		for (int c = 0; c < NumCounters; c++) {
+			if (c) out << ",";
+			out << "\"" << CounterName(Counter(c)) << "\":" << counters[c];
+		}
+		out << "}}\n],\"displayTimeUnit\":\"ms\"}\n";
+		out.precision(old_precision);
+	}
+
+	Stats *Stats::Active() {
+		return active_stats;
+	}
+
+	Stats::Scope::Scope(Stats *s) : prev(active_stats) {
+		active_stats = s;
+	}
+	Stats::Scope::~Scope() {
+		active_stats = prev;
+	}
+
+	Stats::PhaseTimer::PhaseTimer(Phase p, Timestamp t) : stats(active_stats), phase(p), sim_time(t), start(std::chrono::steady_clock::now()) {}
+	Stats::PhaseTimer::~PhaseTimer() {
+		if (!stats) return;
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed = end - start;
+		stats->phase_seconds[phase] += elapsed.count();
+		if (stats->trace) {
+			std::chrono::duration<double, std::micro> since_epoch = start - stats->epoch;
+			stats->events.push_back(TraceEvent{ phase, since_epoch.count(), elapsed.count() * 1e6, sim_time });
+		}
+	}
+}
+#endif // SHARPPHYSICS_STATS
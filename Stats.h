@@ -0,0 +1,115 @@
+#ifndef __SHARPPHYSICS_STATS_H_
+#define __SHARPPHYSICS_STATS_H_
+
+#include "Base.h"
+
+#ifdef SHARPPHYSICS_STATS
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace SharpPhysics {
+	// Stats collects hot-path counters and per-phase timings for a System,
+	// and optionally a timeline of every phase that can be exported as a
+	// Chrome trace-event JSON file (load it in chrome://tracing or Perfetto).
+	//
+	// Stats only exists when SHARPPHYSICS_STATS is defined at compile time;
+	// otherwise System has no stats member and the SHARPPHYSICS_COUNT/
+	// SHARPPHYSICS_TIME macros below compile to nothing.
+	class Stats {
+	public:
+		enum Counter {
+			Calculates,         // System::Calculate calls.
+			Snapshots,          // Snapshots created by CalculateToTime.
+			TransitionActions,  // Actions applied to new snapshots.
+			Rewinds,            // System::RewindToTime calls, and input changes that rewind.
+			Reattaches,         // Rewinds that reattached a cached branch instead of recalculating.
+			WindowWidenings,    // Times Calculate found nothing in its window and checked again with a wider one.
+			PairChecks,         // Circle::TimeUntilCollide calls against a Circle or Line.
+			SweptRejections,    // Pair checks rejected by the swept-segment early-out.
+			BoundsRejections,   // Of those, ones decided by the segments' bounding boxes alone.
+			QuarticSolves,      // Poly::SolveP4 calls.
+			CubicSolves,        // Poly::SolveP3 calls made by SolveQuartic.
+			QuadraticSolves,    // SolveQuadratic calls that solved anything.
+			SignRejections,     // SolveQuartic and SolveQuadratic calls skipped as every root would be moving apart.
+			StaticPairs,        // Circle pairs with no relative motion, solved trivially.
+			LinearPairs,        // Circle pairs with no relative acceleration, solved as a quadratic.
+			CollinearPairs,     // Circle pairs with one stopped, solved as two quadratics.
+			GeneralPairs,       // Circle pairs solved as a quartic.
+			NumCounters
+		};
+		enum Phase {
+			CalculatePhase,  // System::Calculate, ie. finding next_transition.
+			FillPhase,       // Snapshot::FillFromPrevious for a new snapshot.
+			ActionPhase,     // Applying next_transition's Actions.
+			NumPhases
+		};
+		// A TraceEvent is one completed phase, in microseconds of wall time
+		// since the last Reset, tagged with the simulation time it ran at.
+		struct TraceEvent {
+			Phase phase;
+			double start_us, duration_us;
+			Timestamp sim_time;
+		};
+
+		Stats() { Reset(); }
+		void Reset();
+
+		uint64_t Count(Counter c) const { return counters[c]; }
+		double Seconds(Phase p) const { return phase_seconds[p]; }
+		static const char *CounterName(Counter c);
+		static const char *PhaseName(Phase p);
+
+		// If trace is true, every timed phase is also appended to events.
+		bool trace;
+		std::vector<TraceEvent> events;
+
+		// WriteChromeTrace writes events (and the final counter values) in
+		// the Chrome trace-event JSON format.
+		void WriteChromeTrace(std::ostream &out) const;
+
+		// The instrumented free functions (SolveQuartic etc.) have no System
+		// to report to, so counters go to the thread's active Stats, which a
+		// Scope sets for the duration of a System call.
+		static Stats *Active();
+		static void Add(Counter c, uint64_t n) { if (Stats *s = Active()) s->counters[c] += n; }
+
+		class Scope {
+		public:
+			explicit Scope(Stats *s);
+			~Scope();
+		private:
+			Stats *prev;
+		};
+
+		class PhaseTimer {
+		public:
+			PhaseTimer(Phase p, Timestamp sim_time);
+			~PhaseTimer();
+		private:
+			Stats *stats;
+			Phase phase;
+			Timestamp sim_time;
+			std::chrono::steady_clock::time_point start;
+		};
+
+	private:
+		uint64_t counters[NumCounters];
+		double phase_seconds[NumPhases];
+		std::chrono::steady_clock::time_point epoch;
+	};
+}
+
+#define SHARPPHYSICS_COUNT(counter) ::SharpPhysics::Stats::Add(::SharpPhysics::Stats::counter, 1)
+#define SHARPPHYSICS_COUNT_N(counter, n) ::SharpPhysics::Stats::Add(::SharpPhysics::Stats::counter, (n))
+#define SHARPPHYSICS_STATS_SCOPE(stats) ::SharpPhysics::Stats::Scope sharpphysics_stats_scope(stats)
+#define SHARPPHYSICS_TIME(phase, sim_time) ::SharpPhysics::Stats::PhaseTimer sharpphysics_timer_##phase(::SharpPhysics::Stats::phase, (sim_time))
+#else
+#define SHARPPHYSICS_COUNT(counter) ((void)0)
+#define SHARPPHYSICS_COUNT_N(counter, n) ((void)0)
+#define SHARPPHYSICS_STATS_SCOPE(stats) ((void)0)
+#define SHARPPHYSICS_TIME(phase, sim_time) ((void)0)
+#endif
+
+#endif // __SHARPPHYSICS_STATS_H_
@@ -1,4 +1,6 @@
 #include <Logger/logger.h>
+#include <algorithm>
+#include "Math.h"
 #include "System.h"
 
 namespace SharpPhysics {
@@ -7,6 +9,7 @@ namespace SharpPhysics {
 		for (const auto &b : prev.bodies) {
 			bodies[b.first] = std::unique_ptr<Body>(b.second->CopyAfterDuration(t));
 		}
+		filled_after = t;
 	}
 
 	void Snapshot::ForEach(BodyFunc func) const {
@@ -24,108 +27,501 @@ namespace SharpPhysics {
 		Duration d = it.first;
 		auto f = [func, d](Body *b) { func(d, b); };
 		if (include_fixtures) {
-			fixtures.ForEach(f);
+			Fixtures().ForEach(f);
 		}
 		it.second->ForEach(f);
 	}
 
-	void System::RewindToTime(Timestamp ts) {
+	Duration System::SpanAfter(SnapshotIter it) const {
+		auto next = std::next(it);
+		if (next != snapshots.end()) return next->first - it->first;
+		return std::isnan(next_transition.first) ? Infinity : next_transition.first;
+	}
+
+	const SpatialGrid &System::GridFor(SnapshotIter it) {
+		Duration span = SpanAfter(it);
+		auto &grid = grids[it->first];
+		// The last snapshot's span changes as the timeline is calculated.
+		if (!grid || grid->Span() != span || grid->CellSize() != query_cell_size) {
+			grid.reset(new SpatialGrid(*it->second, span, query_cell_size));
+		}
+		return *grid;
+	}
+
+	std::vector<Body *> System::BodiesWithin(Timestamp ts, const Point2d &p, spf r) {
+		SnapshotIter it = std::prev(snapshots.upper_bound(ts));
+		Duration d = ts - it->first;
+		std::vector<Body *> found;
+		auto check = [&found, d, &p, r](Body *body) {
+			if ((body->PositionAfterDuration(d) - p).SqrMagnitude() <= r * r) found.push_back(body);
+		};
+		if (d <= SpanAfter(it)) {
+			GridFor(it).ForEachCandidate(p, r, check);
+		}
+		else {
+			// Beyond the calculated timeline, so no grid covers it.
+			it->second->ForEach(check);
+		}
+		// Candidates can come from several cells.
+		std::sort(found.begin(), found.end(), [](const Body *a, const Body *b) { return a->ID < b->ID; });
+		found.erase(std::unique(found.begin(), found.end()), found.end());
+		return found;
+	}
+
+	Body *System::NearestBody(Timestamp ts, const Point2d &p) {
+		SnapshotIter it = std::prev(snapshots.upper_bound(ts));
+		Duration d = ts - it->first;
+		Body *best = nullptr;
+		spf best_squared = Infinity;
+		auto check = [&best, &best_squared, d, &p](Body *body) {
+			spf dist_squared = (body->PositionAfterDuration(d) - p).SqrMagnitude();
+			if (dist_squared < best_squared || (dist_squared == best_squared && best && body->ID < best->ID)) {
+				best = body;
+				best_squared = dist_squared;
+			}
+		};
+		if (d > SpanAfter(it)) {
+			it->second->ForEach(check);
+			return best;
+		}
+		const SpatialGrid &grid = GridFor(it);
+		spf reach = grid.Reach(p);
+		// Search a growing radius; once the best so far is inside the radius,
+		// anything nearer must have been a candidate too.
+		for (spf r = query_cell_size; ; r *= 2) {
+			grid.ForEachCandidate(p, std::min(r, reach), check);
+			if (best_squared <= r * r || r >= reach) return best;
+		}
+	}
+
+	Timestamp System::TimeOfEntry(BodyID id, const Point2d &center, spf r, Timestamp from) {
+		SnapshotIter it = snapshots.upper_bound(from);
+		if (it != snapshots.begin()) it--;
+		for (; it != snapshots.end(); it++) {
+			auto found = it->second->bodies.find(id);
+			if (found == it->second->bodies.end()) continue;
+			const Body &body = *found->second;
+			Duration start = std::max(from - it->first, 0.0);
+			Duration span = SpanAfter(it);
+			if (!(start <= span)) continue;
+			Point2d pos = body.PositionAfterDuration(start);
+			Vec2d relpos = pos - center;
+			if (relpos.SqrMagnitude() <= r * r) return it->first + start;
+			if (body.IsStopped()) continue;
+			spf coef[5];
+			ApproachQuartic(relpos, body.VelocityAfterDuration(start), body.Acceleration(), r * r, coef);
+			Duration t = SolveQuartic(coef[0], coef[1], coef[2], coef[3], coef[4], true);
+			if (t <= span - start) return it->first + start + t;
+		}
+		return NaN;
+	}
+
+	void System::DiscardFromTime(Timestamp ts) {
 		auto cutoff = snapshots.lower_bound(ts);
+		bool discarding = cutoff != snapshots.end();
 		snapshots.erase(cutoff, snapshots.end());
+		grids.erase(grids.lower_bound(ts), grids.end());
+		trigger_events.erase(std::remove_if(trigger_events.begin(), trigger_events.end(), [ts](const TriggerEvent &e) { return e.time >= ts; }), trigger_events.end());
 		next_transition.first = NaN;
 		next_transition.second.clear();
+		quiescent = false;
+		// Cached branches that forked later were built on what's discarded.
+		branches.remove_if([ts](const Branch &b) { return b.fork > ts; });
+		if (discarding && on_rewind) on_rewind(ts);
+	}
+
+	void System::RewindToTime(Timestamp ts) {
+		SHARPPHYSICS_STATS_SCOPE(&stats);
+		SHARPPHYSICS_COUNT(Rewinds);
+		DiscardFromTime(ts);
 		Calculate();
 	}
 
-	bool System::ShouldAddTransition(Duration t) {
-		if (std::isnan(t) || t > next_transition.first) return false;
-		if (!(next_transition.first == t)) next_transition.second.clear();
-		next_transition.first = t;
+	bool System::KeysFrom(Timestamp ts, InputKeyList *keys) const {
+		keys->clear();
+		for (auto it = input_queue.lower_bound(ts); it != input_queue.end(); it++) {
+			auto found = input_keys.find(it->first);
+			if (found == input_keys.end() || found->second.size() != it->second.size()) return false;
+			for (InputKey key : found->second) {
+				if (key == Unkeyed) return false;
+			}
+			keys->push_back(*found);
+		}
 		return true;
 	}
 
+	void System::ChangeInputs(Timestamp ts, const std::function<void()> &change) {
+		SHARPPHYSICS_STATS_SCOPE(&stats);
+		SHARPPHYSICS_COUNT(Rewinds);
+		bool caching = branch_cache_size > 0 && trigger_subscribers.empty();
+		auto cutoff = snapshots.lower_bound(ts);
+		Branch branch;
+		if (caching && cutoff != snapshots.end() && cutoff != snapshots.begin() && KeysFrom(ts, &branch.keys)) {
+			branch.fork = ts;
+			branch.snapshots.insert(std::make_move_iterator(cutoff), std::make_move_iterator(snapshots.end()));
+		}
+		DiscardFromTime(ts);
+		change();
+		if (!branch.snapshots.empty()) {
+			branches.remove_if([&branch](const Branch &b) { return b.fork == branch.fork && b.keys == branch.keys; });
+			branches.push_front(std::move(branch));
+			if (branches.size() > branch_cache_size) branches.pop_back();
+		}
+		InputKeyList keys;
+		if (caching && KeysFrom(ts, &keys)) {
+			for (auto it = branches.begin(); it != branches.end(); it++) {
+				if (it->fork != ts || it->keys != keys) continue;
+				SHARPPHYSICS_COUNT(Reattaches);
+				Branch found = std::move(*it);
+				branches.erase(it);
+				for (auto &ss : found.snapshots) {
+					auto prev = std::prev(snapshots.cend());
+					Duration d = std::isnan(ss.second->filled_after) ? ss.first - prev->first : ss.second->filled_after;
+					auto added = snapshots.emplace_hint(snapshots.end(), ss.first, std::move(ss.second));
+					if (on_snapshot) on_snapshot(added->first, d, *prev->second, *added->second);
+				}
+				break;
+			}
+		}
+		Calculate();
+	}
+
+	void System::InsertSnapshot(Timestamp ts, std::unique_ptr<Snapshot> ss) {
+		DiscardFromTime(ts);
+		snapshots[ts] = std::move(ss);
+	}
+
+	bool System::IsStalled(const Body &body, Timestamp ts) {
+		return !(ts + body.TimeUntilStop() > ts);
+	}
+
+	bool System::ShouldAddTransition(Duration t) const {
+		return !std::isnan(t) && !(t > Horizon());
+	}
+
+	void System::AddTransition(Duration t, Action action, bool exact) {
+		if (!(t >= next_transition.first)) next_transition.first = t;
+		candidates.push_back(Candidate{ t, exact, std::move(action) });
+	}
+
+	void System::ResolveTransitions() {
+		next_transition.second.clear();
+		if (candidates.empty()) return;
+		std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) { return a.t < b.t; });
+		Duration first = next_transition.first;
+		Duration limit = Horizon();
+		for (auto &c : candidates) {
+			if (c.t > limit) break;
+			// Inputs sort before anything else at their time, so stopping at
+			// a later input also stops anything being pulled back past it.
+			if (c.exact && c.t > first) break;
+			next_transition.second.push_back(std::move(c.action));
+		}
+		candidates.clear();
+	}
+
+	void System::SubmitInputEvent(Timestamp ts, Action action, InputKey key) {
+		submitted_inputs.Push(ts, std::move(action), key);
+	}
+
+	void System::TakeSubmittedInputs() {
+		if (submitted_inputs.Empty()) return;
+		auto inputs = submitted_inputs.Drain();
+		if (inputs.empty()) return;
+		ChangeInputs(inputs.front().t, [this, &inputs]() {
+			for (auto &input : inputs) {
+				input_queue[input.t].push_back(std::move(input.action));
+				input_keys[input.t].push_back(input.key);
+			}
+		});
+	}
+
+	void System::Collide(Timestamp t, Body *body, Body *other) {
+		if (body->IsTangible() && other->IsTangible()) {
+			body->ApplyCollision(other);
+			return;
+		}
+		Body *trigger = other->IsTangible() ? body : other;
+		Body *visitor = (trigger == other) ? body : other;
+		if (trigger_subscribers.find(trigger->ID) == trigger_subscribers.end()) return;
+		trigger_events.push_back(TriggerEvent{ t, visitor->ID, trigger->ID, body->IsApproaching(*other) });
+	}
+
+	void System::SubscribeTrigger(BodyID trigger, TriggerFunc func) {
+		trigger_subscribers[trigger].push_back(func);
+	}
+
+	void System::DeliverTriggerEvents() {
+		if (trigger_events.empty()) return;
+		// Coalesced transitions can be applied out of exact time order.
+		std::stable_sort(trigger_events.begin(), trigger_events.end(), [](const TriggerEvent &a, const TriggerEvent &b) { return a.time < b.time; });
+		// Move the events out first, in case a subscriber calculates further.
+		std::vector<TriggerEvent> events;
+		events.swap(trigger_events);
+		std::vector<TriggerEvent> batch;
+		for (const auto &sub : trigger_subscribers) {
+			batch.clear();
+			for (const auto &e : events) {
+				if (e.trigger == sub.first) batch.push_back(e);
+			}
+			if (batch.empty()) continue;
+			for (const auto &func : sub.second) {
+				func(batch);
+			}
+		}
+	}
+
+	const BodyInfo *System::AddBodyInfo(const BodyInfo &info) {
+		auto added = body_info.emplace(info.id, info);
+		if (!added.second) throw "Body ID already has a BodyInfo";
+		return &added.first->second;
+	}
+
+	std::unique_ptr<Body> System::NewCircle(BodyID id, std::shared_ptr<ExtraData> e, const Point2d &pos, spf r, spf fric, spf mas) {
+		return std::unique_ptr<Body>(new Circle(AddBodyInfo(BodyInfo{ id, e, fric, mas, r }), pos));
+	}
+
+	std::unique_ptr<Body> System::NewLine(BodyID id, std::shared_ptr<ExtraData> e, const Point2d &start, const Point2d &end, spf mas) {
+		return std::unique_ptr<Body>(new Line(AddBodyInfo(BodyInfo{ id, e, 0.0, mas, 0.0 }), start, end));
+	}
+
 	void System::AddImpulseEvent(Timestamp ts, BodyID id, const Vec2d &line) {
-		AddInputEvent(ts, [id, line](Snapshot *ss) { ss->GetBody(id)->AddVelocity(line); });
+		AddInputEvent(ts, [id, line](Snapshot *ss) { ss->GetBody(id)->AddVelocity(line); }, ImpulseKey(id, line));
+	}
+
+	// Fnv1a folds the bytes of data into an FNV-1a hash.
+	static const std::uint64_t fnv1a_basis = 14695981039346656037ULL;
+	template <typename T>
+	static void Fnv1a(std::uint64_t *hash, const T &data) {
+		const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&data);
+		for (size_t i = 0; i < sizeof(T); i++) {
+			*hash = (*hash ^ bytes[i]) * 1099511628211ULL;
+		}
+	}
+
+	InputKey System::ImpulseKey(BodyID id, const Vec2d &line) {
+		InputKey hash = fnv1a_basis;
+		Fnv1a(&hash, id);
+		Fnv1a(&hash, line.x);
+		Fnv1a(&hash, line.y);
+		return hash == Unkeyed ? 1 : hash;
+	}
+
+	std::uint64_t System::TimelineDigest() const {
+		std::uint64_t hash = fnv1a_basis;
+		for (const auto &ss : snapshots) {
+			Fnv1a(&hash, ss.first);
+			for (const auto &b : ss.second->bodies) {
+				const Body &body = *b.second;
+				Fnv1a(&hash, body.ID);
+				Fnv1a(&hash, body.IsStopped());
+				Fnv1a(&hash, body.Position().x);
+				Fnv1a(&hash, body.Position().y);
+				Fnv1a(&hash, body.Velocity().x);
+				Fnv1a(&hash, body.Velocity().y);
+			}
+		}
+		return hash;
 	}
 
-	void System::AddInputEvent(Timestamp ts, Action action) {
-		input_queue[ts].push_back(action);
-		RewindToTime(ts);
+	void System::AddInputEvent(Timestamp ts, Action action, InputKey key) {
+		ChangeInputs(ts, [&]() {
+			input_queue[ts].push_back(std::move(action));
+			input_keys[ts].push_back(key);
+		});
 	}
 
+	bool System::RemoveInputEvent(Timestamp ts, InputKey key) {
+		auto actions = input_queue.find(ts);
+		auto keys = input_keys.find(ts);
+		if (key == Unkeyed || actions == input_queue.end() || keys == input_keys.end() || keys->second.size() != actions->second.size()) return false;
+		auto found = std::find(keys->second.begin(), keys->second.end(), key);
+		if (found == keys->second.end()) return false;
+		size_t index = found - keys->second.begin();
+		ChangeInputs(ts, [&]() {
+			actions->second.erase(actions->second.begin() + index);
+			keys->second.erase(keys->second.begin() + index);
+			if (actions->second.empty()) {
+				input_queue.erase(actions);
+				input_keys.erase(keys);
+			}
+		});
+		return true;
+	}
+
+	// Calculate's first collision window is never less than this fraction
+	// of prediction_window, so one very short interval doesn't cost lots of
+	// widening; and after max_window_widenings, it gives up on windowing.
+	static const spf min_window_fraction = 16;
+	static const spf window_growth = 4;
+	static const int max_window_widenings = 6;
+
 	void System::Calculate() {
+		SHARPPHYSICS_STATS_SCOPE(&stats);
+		SHARPPHYSICS_COUNT(Calculates);
+		auto it = std::prev(snapshots.cend());
+		Timestamp ts = it->first;
+		SHARPPHYSICS_TIME(CalculatePhase, ts);
+		CollisionSearch search;
+		if (!BeginCalculate(&search)) return;
+		do {
+			FindCollisions(*it->second, ts, search.window);
+		} while (WidenSearch(&search));
+		EndCalculate();
+	}
+
+	bool System::BeginCalculate(CollisionSearch *search) {
 		auto it = std::prev(snapshots.cend());
 		Timestamp ts = it->first;
 		const Snapshot &ss = *it->second;
 		auto next_input = input_queue.upper_bound(ts);
+		next_transition.first = NaN;
 		next_transition.second.clear();
+		candidates.clear();
 		if (next_input != input_queue.end()) {
-			auto end_input = input_queue.upper_bound(next_input->first);
-			next_transition.first = next_input->first - ts;
-			for (auto it = next_input; it != end_input; it++) {
-				next_transition.second.insert(next_transition.second.end(), it->second.begin(), it->second.end());
+			// Only the inputs for the next input timestamp; any later ones
+			// can't be coalesced into this transition anyway.
+			for (const auto &action : next_input->second) {
+				AddTransition(next_input->first - ts, action, true);
 			}
 		}
-		else {
-			next_transition.first = NaN;
-			next_transition.second.clear();
-		}
 		// Check for friction stops.
+		bool all_stopped = true;
 		for (auto it = ss.bodies.begin(); it != ss.bodies.end(); it++) {
 			if (it->second->IsStopped()) continue;
 			BodyID id = it->first;
 			Duration stops_at = it->second->TimeUntilStop();
-			if (ShouldAddTransition(stops_at)) {
-				next_transition.second.emplace_back([id](Snapshot *ss) {ss->GetBody(id)->Stop(); });
+			if (IsStalled(*it->second, ts)) {
+				// AddNextSnapshot stops such bodies, but this snapshot came from
+				// elsewhere (eg. it's the first), and may already have been
+				// published, so rather than change it, stop the body at the
+				// next time after ts there is.
+				stops_at = std::nextafter(ts, Infinity) - ts;
+			}
+			all_stopped = false;
+			// Frictionless bodies never stop.
+			if (!std::isinf(stops_at) && ShouldAddTransition(stops_at)) {
+				AddTransition(stops_at, [id](Snapshot *ss) {ss->GetBody(id)->Stop(); });
 			}
 		}
-		// Check for collisions.
+		quiescent = all_stopped && next_input == input_queue.end();
+		if (quiescent) return false;
+		search->window = std::isnan(last_interval) ? prediction_window : std::max(2 * last_interval, prediction_window / min_window_fraction);
+		search->widenings = 0;
+		search->base_candidates = candidates.size();
+		search->base_first = next_transition.first;
+		return true;
+	}
+
+	bool System::WidenSearch(CollisionSearch *search) {
+		if (std::isinf(search->window) || Horizon() <= search->window) return false;
+		// Nothing within the window, so the collisions found (beyond it)
+		// may not be the earliest; start them again with a wider one.
+		SHARPPHYSICS_COUNT(WindowWidenings);
+		candidates.resize(search->base_candidates);
+		next_transition.first = search->base_first;
+		search->window = (search->widenings < max_window_widenings) ? search->window * window_growth : Infinity;
+		search->widenings++;
+		return true;
+	}
+
+	void System::EndCalculate() {
+		if (!std::isnan(next_transition.first)) last_interval = next_transition.first;
+		ResolveTransitions();
+	}
+
+	void System::FindCollisions(const Snapshot &ss, Timestamp ts, Duration window) {
 		for (auto it = ss.bodies.begin(); it != ss.bodies.end(); it++) {
 			if (it->second->IsStopped()) continue;
-			BodyID id = it->first;
 			// Check for stopped bodies earlier than this one.
 			for (auto other = ss.bodies.begin(); other != it; other++) {
 				if (!other->second->IsStopped()) continue;
-				BodyID other_id = other->first;
-				Duration ctime = it->second->TimeUntilCollide(*other->second, next_transition.first);
-				if (ShouldAddTransition(ctime)) {
-					next_transition.second.emplace_back([id, other_id](Snapshot *ss) {
-						ss->GetBody(id)->ApplyCollision(ss->GetBody(other_id));
-					});
-				}
+				CheckPair(ts, *it->second, *other->second, window);
 			}
 			// Check against all bodies later than this one.
 			for (auto other = std::next(it); other != ss.bodies.end(); other++) {
-				BodyID other_id = other->first;
-				Duration ctime = it->second->TimeUntilCollide(*other->second, next_transition.first);
-				if (ShouldAddTransition(ctime)) {
-					next_transition.second.emplace_back([this, id, other_id](Snapshot *ss) {
-						ss->GetBody(id)->ApplyCollision(ss->GetBody(other_id));
-					});
-				}
+				CheckPair(ts, *it->second, *other->second, window);
 			}
 			// Check against fixtures.
-			for (auto other = fixtures.bodies.begin(); other != fixtures.bodies.end(); other++) {
-				Body *other_body = other->second.get();
-				Duration ctime = it->second->TimeUntilCollide(*other_body, next_transition.first);
-				if (ShouldAddTransition(ctime)) {
-					next_transition.second.emplace_back([this, id, other_body](Snapshot *ss) {
-						ss->GetBody(id)->ApplyCollision(other_body);
-					});
-				}
+			const Snapshot &fixed = Fixtures();
+			for (auto other = fixed.bodies.begin(); other != fixed.bodies.end(); other++) {
+				CheckFixture(ts, *it->second, other->second.get(), window);
 			}
 		}
 	}
 
-	void System::CalculateToTime(Timestamp t) {
+	void System::CheckPair(Timestamp ts, const Body &body, const Body &other, Duration window) {
+		Duration ctime = body.TimeUntilCollide(other, std::fmin(window, Horizon()));
+		if (!ShouldAddTransition(ctime)) return;
+		Timestamp at = ts + ctime;
+		BodyID id = body.ID;
+		BodyID other_id = other.ID;
+		AddTransition(ctime, [this, at, id, other_id](Snapshot *ss) {
+			Collide(at, ss->GetBody(id), ss->GetBody(other_id));
+		}, IsTriggerContact(body, other));
+	}
+
+	void System::CheckFixture(Timestamp ts, const Body &body, Body *fixture, Duration window) {
+		Duration ctime = body.TimeUntilCollide(*fixture, std::fmin(window, Horizon()));
+		if (!ShouldAddTransition(ctime)) return;
+		Timestamp at = ts + ctime;
+		BodyID id = body.ID;
+		AddTransition(ctime, [this, at, id, fixture](Snapshot *ss) {
+			Collide(at, ss->GetBody(id), fixture);
+		}, IsTriggerContact(body, *fixture));
+	}
+
+	void System::Step() {
+		AddNextSnapshot();
+		Calculate();
+	}
+
+	void System::AddNextSnapshot() {
 		auto end = std::prev(snapshots.cend());
-		if (!(t > end->first + next_transition.first)) return;
-		auto &ss = snapshots[end->first + next_transition.first];
-		ss->FillFromPrevious(*end->second, next_transition.first);
-		for (const auto &action : next_transition.second) {
-			action(ss.get());
+		Timestamp ts = end->first + next_transition.first;
+		// The new snapshot is filled from the latest one, so it must come after it.
+		if (!(ts > end->first)) throw "Transition isn't after the latest snapshot";
+		std::unique_ptr<Snapshot> ss(new Snapshot());
+		SHARPPHYSICS_COUNT(Snapshots);
+		{
+			SHARPPHYSICS_TIME(FillPhase, ts);
+			ss->FillFromPrevious(*end->second, next_transition.first);
 		}
-		Calculate();
-		CalculateToTime(t);
+		{
+			SHARPPHYSICS_TIME(ActionPhase, ts);
+			SHARPPHYSICS_COUNT_N(TransitionActions, next_transition.second.size());
+			for (const auto &action : next_transition.second) {
+				action(ss.get());
+			}
+		}
+		// A transition to stop a stalled body would land on this snapshot, so
+		// stop it now, before anything sees the snapshot; once published, a
+		// snapshot never changes.
+		for (auto &b : ss->bodies) {
+			if (!b.second->IsStopped() && IsStalled(*b.second, ts)) b.second->Stop();
+		}
+		auto added = snapshots.emplace_hint(snapshots.end(), ts, std::move(ss));
+		if (on_snapshot) on_snapshot(ts, next_transition.first, *end->second, *added->second);
+	}
+
+	void System::CalculateToTime(Timestamp t) {
+		TakeSubmittedInputs();
+		if (quiescent) return;
+		SHARPPHYSICS_STATS_SCOPE(&stats);
+		while (t > NextTransitionTime()) {
+			Step();
+		}
+		DeliverTriggerEvents();
+	}
+
+	std::pair<Timestamp, Snapshot*> System::CalculateToRest(Timestamp deadline) {
+		SHARPPHYSICS_STATS_SCOPE(&stats);
+		TakeSubmittedInputs();
+		while (!quiescent && NextTransitionTime() <= deadline) {
+			Step();
+		}
+		DeliverTriggerEvents();
+		auto last = std::prev(snapshots.cend());
+		return std::make_pair(quiescent ? last->first : NaN, last->second.get());
 	}
 }
@@ -1,12 +1,17 @@
 #ifndef __SHARPPHYSICS_SYSTEM_H_
 #define __SHARPPHYSICS_SYSTEM_H_
 
+#include <cstdint>
 #include <functional>
+#include <list>
 #include <map>
 #include <set>
 #include <memory>
 #include <vector>
 #include "Body.h"
+#include "InputQueue.h"
+#include "Query.h"
+#include "Stats.h"
 
 namespace SharpPhysics {
 	typedef spf Timestamp;
@@ -30,16 +35,28 @@ namespace SharpPhysics {
 		// or external impulse, then for the bodies involved in the collision
 		// or impulse, update their velocity appropriately in this new snapshot.
 		void FillFromPrevious(const Snapshot &prev, Duration t);
+
+		// The duration after the previous snapshot that FillFromPrevious
+		// filled this one from; NaN if it wasn't filled.
+		Duration filled_after = NaN;
+	};
+
+	// A TriggerEvent reports a body entering (coming into contact with) or
+	// leaving an intangible body such as a pocket or a lane line, at the
+	// exact time of contact.
+	struct TriggerEvent {
+		Timestamp time;
+		BodyID body;
+		BodyID trigger;
+		bool entering;
 	};
+	typedef std::function<void(const std::vector<TriggerEvent> &events)> TriggerFunc;
 
-	// An Action is typically a lambda that operates on a snapshot, eg.
-	// one possible Action might be [body_id](Snapshot *ss) {
-	//   ss->GetBody(body_id)->Stop();
-	// }
-	// This action would cause the body identified by body_id to stop,
-	// in the snapshot on which it is called (usually a newly created
-	// snapshot).
-	typedef std::function<void(Snapshot *ss)> Action;
+	// A SnapshotFunc is told about each new snapshot: its timestamp, the
+	// duration after the previous snapshot it was filled from, and both
+	// snapshots.
+	typedef std::function<void(Timestamp ts, Duration d, const Snapshot &prev, const Snapshot &ss)> SnapshotFunc;
+	typedef std::function<void(Timestamp ts)> RewindFunc;
 
 	// A System contains a series of snapshots which enables replaying of
 	// the simulation from any point. There is also a single Snapshot,
@@ -52,25 +69,100 @@ namespace SharpPhysics {
 		Snapshot fixtures;
 		std::map<Timestamp, std::vector<Action>> input_queue;
 
+		// If set, shared_fixtures is used in place of fixtures (which should
+		// then be left empty), so several Systems can share one set, eg. in an
+		// Ensemble. It must outlive this System.
+		const Snapshot *shared_fixtures = nullptr;
+		const Snapshot &Fixtures() const { return shared_fixtures ? *shared_fixtures : fixtures; }
+
+		// body_info holds the unchanging properties of every body, in the
+		// snapshots or the fixtures, by BodyID; Bodies point into it, so an
+		// entry is never removed or replaced once added.
+		std::map<BodyID, BodyInfo> body_info;
+
+		// AddBodyInfo adds info to body_info, returning the stored copy to
+		// construct the body's Body with. Throws if its id is already there.
+		const BodyInfo *AddBodyInfo(const BodyInfo &info);
+
+		// NewCircle and NewLine add a body's BodyInfo and return a Body for
+		// it, to be put in a snapshot (or, usually for lines, the fixtures).
+		std::unique_ptr<Body> NewCircle(BodyID id, std::shared_ptr<ExtraData> e, const Point2d &pos, spf r, spf fric = 0.0, spf mas = Infinity);
+		std::unique_ptr<Body> NewLine(BodyID id, std::shared_ptr<ExtraData> e, const Point2d &start, const Point2d &end, spf mas = Infinity);
+
 		// Duration is the time between the last snapshot and the transition.
 		std::pair<Duration, std::vector<Action>> next_transition;
 
+		// Transitions that occur within coalesce_window after the earliest
+		// one are resolved together, in a single snapshot at the earliest
+		// time, instead of each getting a snapshot (and a Calculate) of its
+		// own. Actions are applied in order of their exact time, then in
+		// discovery order (inputs, friction stops by BodyID, collisions by
+		// BodyID pair), so the result is deterministic. Input events, and
+		// contacts with intangible bodies, are never moved earlier than
+		// their time. Zero only merges transitions that are exactly
+		// simultaneous.
+		Duration coalesce_window = 0;
+
+		// Calculate first looks for collisions within a short window ahead,
+		// where the swept-path early-out rejects most pairs cheaply, and only
+		// widens it (checking the pairs again) if nothing happens within it.
+		// The window starts at twice the previous interval between
+		// transitions, or prediction_window if there isn't one yet, and never
+		// goes past the earliest friction stop or input. Infinity turns
+		// windowing off.
+		Duration prediction_window = 1.0;
+
+		// If set, on_snapshot is called for every snapshot CalculateToTime (or
+		// CalculateToRest) creates, once its Actions have been applied, and
+		// on_rewind is called when RewindToTime discards any snapshots.
+		SnapshotFunc on_snapshot;
+		RewindFunc on_rewind;
+
+#ifdef SHARPPHYSICS_STATS
+		// Counters and timings for this System's calls.
+		Stats stats;
+#endif
+
 		// Must call Calculate after initialization, and after inserting to input_queue.
 		// Calculate figures out what next_transition is.
 		void Calculate();
 
 		// CalculateToTime checks if time t is beyond next_transition; if it
 		// is, a new snapshot is created at the moment of next_transition,
-		// next_transition's Actions are applied, and CalculateToTime is
-		// executed again.
+		// next_transition's Actions are applied, Calculate is called, and
+		// this repeats until next_transition is beyond t. Any TriggerEvents
+		// that occurred are then delivered.
 		void CalculateToTime(Timestamp t);
 
+		// CalculateToRest advances the simulation straight to the moment every
+		// body has stopped, with no input events pending, without stepping
+		// through any intermediate times. It stops early if the next
+		// transition would be after 'deadline'. Returns the timestamp at which
+		// the system came to rest (NaN if it didn't by the deadline, or never
+		// will, eg. because of frictionless bodies) and the latest snapshot.
+		std::pair<Timestamp, Snapshot*> CalculateToRest(Timestamp deadline = Infinity);
+
+		// IsQuiescent returns true if every body has stopped and there are no
+		// input events pending, in which case CalculateToTime returns
+		// immediately until a new input is added.
+		bool IsQuiescent() const { return quiescent; }
+
 		// RewindToTime removes snapshots after time t. To insert a backdated
 		// input, for example, one would RewindToTime(new_input_time), add the
 		// input to input_queue, then CalculateToTime(current_time), and the
 		// world will be updated as if the input had occurred at time t.
 		void RewindToTime(Timestamp t);
 
+		// DiscardFromTime removes snapshots at or after time t, like
+		// RewindToTime but without recalculating next_transition.
+		void DiscardFromTime(Timestamp t);
+
+		// InsertSnapshot discards any snapshots at or after time t, and adds
+		// ss as the latest snapshot, eg. for a client rebuilding a timeline
+		// from replicated state. It doesn't Calculate; call Calculate before
+		// advancing from the new snapshot with CalculateToTime.
+		void InsertSnapshot(Timestamp t, std::unique_ptr<Snapshot> ss);
+
 		// Call a function for every body at timestamp t. A duration is provided
 		// to the target function so that, eg. one could check for bodies with
 		// x > 5 at time q with something like
@@ -82,20 +174,195 @@ namespace SharpPhysics {
 		void ForEachAt(Timestamp t, DurationBodyFunc func, bool include_fixtures = DontIncludeFixtures);
 
 		// Convenience wrapper around AddInputEvent; adds an InputEvent
-		// that updates a single body's velocity by the vector [line].
+		// that updates a single body's velocity by the vector [line]. It's
+		// keyed by its arguments, so an identical impulse has the same key.
 		void AddImpulseEvent(Timestamp t, BodyID id, const Vec2d &line);
 
-		// Add an Action to occur on a new snapshot at time t.
-		void AddInputEvent(Timestamp t, Action action);
+		// Add an Action to occur on a new snapshot at time t. If a key other
+		// than Unkeyed is given, the timeline can be reused from the branch
+		// cache (see below).
+		void AddInputEvent(Timestamp t, Action action, InputKey key = Unkeyed);
+
+		// RemoveInputEvent removes the input with this key at time t (the
+		// first, if there are several) and recalculates from t, eg. when a
+		// predicted input is withdrawn. Returns false, changing nothing, if
+		// there's no such input.
+		bool RemoveInputEvent(Timestamp t, InputKey key);
+
+		// ImpulseKey returns the key AddImpulseEvent uses.
+		static InputKey ImpulseKey(BodyID id, const Vec2d &line);
+
+		// When inputs are added or removed, the future being discarded is kept
+		// in a cache of up to branch_cache_size branches, keyed by the time it
+		// forked and the keys of the inputs from then on. If the inputs change
+		// back to a cached set (eg. a predicted input is withdrawn, or replaced
+		// by an identical one), the branch is reattached instead of being
+		// recalculated, and on_snapshot is called for each of its snapshots.
+		// Only timelines whose inputs are all keyed are cached, and nothing is
+		// cached while any triggers are subscribed, since reattaching wouldn't
+		// report their events. Zero turns the cache off.
+		size_t branch_cache_size = 8;
+
+		// SubmitInputEvent is AddInputEvent for any thread, with no locking:
+		// it may be called concurrently with anything, including another
+		// thread running CalculateToTime. Submitted inputs are taken in at the
+		// start of the next CalculateToTime or CalculateToRest (or a later
+		// one, while an earlier submission is still being made), ordered by
+		// timestamp then submission order, with a single rewind to the
+		// earliest of them. As with AddInputEvent, keyed inputs can be
+		// removed with RemoveInputEvent and let the branch cache be used.
+		void SubmitInputEvent(Timestamp t, Action action, InputKey key = Unkeyed);
+
+		// SubscribeTrigger calls func with the TriggerEvents of the intangible
+		// body whose ID is 'trigger' (in the fixtures or the snapshots). Events
+		// are delivered in time order, as one batch per trigger at the end of
+		// each CalculateToTime that produced any, so triggers never need to be
+		// polled. Events are reported as the timeline is calculated, so after
+		// a RewindToTime, events after the rewind time will be reported again
+		// as the simulation is recalculated.
+		void SubscribeTrigger(BodyID trigger, TriggerFunc func);
 
 		// Return the snapshot that covers time t, and the duration after that
 		// snapshot that time t would be at.
 		std::pair<Duration, Snapshot*> At(Timestamp t);
 
+		// TimelineDigest returns a hash of every snapshot's timestamp and the
+		// exact bits of its bodies' state. Clients (or builds, eg. with and
+		// without AVX2) running the same simulation must get the same digest,
+		// so comparing digests is a cheap check for a desync.
+		std::uint64_t TimelineDigest() const;
+
+		// The spatial queries below consider the bodies in the snapshots (not
+		// the fixtures) by the positions of their centers at time t. They use
+		// a SpatialGrid per snapshot, built on first use and kept until that
+		// snapshot is rewound. Returned Bodies are from the snapshot covering
+		// t, so their positions at t are body->PositionAfterDuration(At(t).first).
+
+		// BodiesWithin returns the bodies whose centers are within r of p at
+		// time t, in BodyID order.
+		std::vector<Body *> BodiesWithin(Timestamp t, const Point2d &p, spf r);
+
+		// NearestBody returns the body whose center is nearest to p at time t
+		// (the lowest BodyID on a tie), or nullptr if there are no bodies.
+		Body *NearestBody(Timestamp t, const Point2d &p);
+
+		// TimeOfEntry returns the first time, at or after 'from', that body
+		// id's center is within r of 'center', solved analytically between
+		// snapshots. Only the calculated timeline is searched (up to
+		// next_transition); returns NaN if the body doesn't enter the region
+		// in that time.
+		Timestamp TimeOfEntry(BodyID id, const Point2d &center, spf r, Timestamp from);
+
+		// The cell size for the queries' SpatialGrids; around the typical
+		// spacing between bodies works well.
+		spf query_cell_size = 1.0;
+
 		static const bool IncludeFixtures = true;
 		static const bool DontIncludeFixtures = false;
 	private:
-		bool ShouldAddTransition(Duration t);
+		// An Ensemble steps its variants itself, to search for their
+		// collisions together.
+		friend class Ensemble;
+
+		// A Candidate is a transition found by Calculate that may end up in
+		// next_transition. Exact candidates (inputs and trigger contacts) are
+		// never coalesced into an earlier snapshot: an input must see the
+		// state at its own time, and a body pulled back short of a trigger
+		// would just find the same contact again.
+		struct Candidate {
+			Duration t;
+			bool exact;
+			Action action;
+		};
+		std::vector<Candidate> candidates;
+
+		// Horizon is the latest time a transition can be and still be part
+		// of next_transition, ie. the earliest transition plus
+		// coalesce_window, or NaN if there's no transition yet.
+		Duration Horizon() const { return next_transition.first + coalesce_window; }
+		bool quiescent = false;
+		// The interval Calculate last found to next_transition.
+		Duration last_interval = NaN;
+		ConcurrentInputQueue submitted_inputs;
+
+		// input_keys parallels input_queue with each input's key.
+		std::map<Timestamp, std::vector<InputKey>> input_keys;
+		typedef std::vector<std::pair<Timestamp, std::vector<InputKey>>> InputKeyList;
+		struct Branch {
+			Timestamp fork;
+			InputKeyList keys;
+			std::map<Timestamp, std::unique_ptr<Snapshot>> snapshots;
+		};
+		// Most recently used first.
+		std::list<Branch> branches;
+		// KeysFrom sets *keys to the keys of the inputs at or after t, and
+		// returns false if any of them is unkeyed.
+		bool KeysFrom(Timestamp t, InputKeyList *keys) const;
+		// ChangeInputs calls change to alter the inputs at or after t, then
+		// recalculates from t, stashing the discarded branch in, or reattaching
+		// one from, the branch cache.
+		void ChangeInputs(Timestamp t, const std::function<void()> &change);
+		std::map<Timestamp, std::unique_ptr<SpatialGrid>> grids;
+		std::map<BodyID, std::vector<TriggerFunc>> trigger_subscribers;
+		std::vector<TriggerEvent> trigger_events;
+
+		// IsStalled returns true if a moving body in the snapshot at ts would
+		// stop before any later timestamp (eg. after a tiny impulse).
+		static bool IsStalled(const Body &body, Timestamp ts);
+		bool ShouldAddTransition(Duration t) const;
+		void AddTransition(Duration t, Action action, bool exact = false);
+		// ResolveTransitions moves the candidates that fall in the coalescing
+		// window into next_transition, in resolution order.
+		void ResolveTransitions();
+		// A CollisionSearch is where Calculate is in looking for collisions
+		// within a widening window.
+		struct CollisionSearch {
+			Duration window;
+			int widenings;
+			// The candidates and next_transition.first before any collisions.
+			size_t base_candidates;
+			Duration base_first;
+		};
+		// Calculate is done in phases, so an Ensemble can run the collision
+		// search across its variants. BeginCalculate adds the inputs and
+		// friction stops from the latest snapshot and sets quiescent; unless
+		// it's quiescent, it starts *search and returns true. After each
+		// FindCollisions pass, WidenSearch returns false if the collisions
+		// found are final, or discards them and widens the window. Then
+		// EndCalculate resolves next_transition.
+		bool BeginCalculate(CollisionSearch *search);
+		bool WidenSearch(CollisionSearch *search);
+		void EndCalculate();
+		// FindCollisions adds the collisions between bodies in ss (at ts), and
+		// with the fixtures, up to window or Horizon, whichever is sooner.
+		void FindCollisions(const Snapshot &ss, Timestamp ts, Duration window);
+		// CheckPair adds any collision between body and other (both in the
+		// snapshot at ts) as FindCollisions does; CheckFixture is the same for
+		// a fixture.
+		void CheckPair(Timestamp ts, const Body &body, const Body &other, Duration window);
+		void CheckFixture(Timestamp ts, const Body &body, Body *fixture, Duration window);
+
+		// Collide is the Action for a collision at time t; it either applies
+		// the collision, or if either body is intangible, records a
+		// TriggerEvent.
+		void Collide(Timestamp t, Body *body, Body *other);
+		static bool IsTriggerContact(const Body &body, const Body &other) { return !body.IsTangible() || !other.IsTangible(); }
+		void DeliverTriggerEvents();
+
+		// NextTransitionTime returns the timestamp of next_transition.
+		Timestamp NextTransitionTime() const { return std::prev(snapshots.cend())->first + next_transition.first; }
+		// TakeSubmittedInputs moves any submitted inputs into input_queue.
+		void TakeSubmittedInputs();
+		// Step creates the snapshot for next_transition, applies its Actions
+		// and calls Calculate. AddNextSnapshot is Step without the Calculate.
+		void Step();
+		void AddNextSnapshot();
+
+		typedef std::map<Timestamp, std::unique_ptr<Snapshot>>::const_iterator SnapshotIter;
+		// SpanAfter returns how long the snapshot at 'it' covers; Infinity for
+		// the last snapshot if there's no next_transition.
+		Duration SpanAfter(SnapshotIter it) const;
+		const SpatialGrid &GridFor(SnapshotIter it);
 	};
 
 }
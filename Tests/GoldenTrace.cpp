@@ -0,0 +1,131 @@
+// GoldenTrace runs a few fixed scenes and checks each one's
+// System::TimelineDigest against the digest pinned here, so that every
+// build (Release and ReleaseAVX2, Win32 and x64) is checked against the
+// same snapshots bit for bit. It prints every digest, and returns non-zero
+// if any doesn't match, or isn't pinned for this build, so that it can't
+// pass without checking anything.
+//
+// If a change is meant to alter the simulation, update the pinned digests
+// from the printed ones, and note it: clients built before and after won't
+// agree.
+#include <cinttypes>
+#include <cstdio>
+#include <vector>
+#include "../Scene.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <math.h>
+#endif
+
+using namespace SharpPhysics;
+
+// Table adds the cushions of a 20x10 table, and a rack of 15 balls in front
+// of a cue ball, all with the given friction.
+static void Table(spf friction, std::vector<CircleDef> *circles, std::vector<LineDef> *lines) {
+	const spf r = 0.25;
+	int id = 0;
+	for (int row = 0; row < 5; row++) {
+		for (int i = 0; i <= row; i++) {
+			spf x = 14 + row * r * 1.75;
+			spf y = 5 + (i - row / 2.0) * r * 2.02;
+			circles->push_back(CircleDef{ id++, nullptr, Point2d{ x, y }, Vec2d::Zero, r, friction, 1.0 });
+		}
+	}
+	circles->push_back(CircleDef{ 100, nullptr, Point2d{ 4, 5.03 }, Vec2d{ 9, 0.1 }, r, friction, 1.0 });
+	lines->push_back(LineDef{ 200, nullptr, Point2d{ 0, 0 }, Point2d{ 20, 0 }, Infinity });
+	lines->push_back(LineDef{ 201, nullptr, Point2d{ 20, 0 }, Point2d{ 20, 10 }, Infinity });
+	lines->push_back(LineDef{ 202, nullptr, Point2d{ 20, 10 }, Point2d{ 0, 10 }, Infinity });
+	lines->push_back(LineDef{ 203, nullptr, Point2d{ 0, 10 }, Point2d{ 0, 0 }, Infinity });
+}
+
+// Frictionless only ever solves quadratics, with +, -, *, / and sqrt, which
+// IEEE 754 rounds the same way everywhere.
+static std::uint64_t Frictionless() {
+	std::vector<CircleDef> circles;
+	std::vector<LineDef> lines;
+	Table(0, &circles, &lines);
+	System s;
+	BuildScene(&s, circles, lines);
+	s.CalculateToTime(20);
+	return s.TimelineDigest();
+}
+
+// Triggers adds intangible lines, coalescing and later impulses to the
+// frictionless table.
+static std::uint64_t Triggers() {
+	std::vector<CircleDef> circles;
+	std::vector<LineDef> lines;
+	Table(0, &circles, &lines);
+	lines.push_back(LineDef{ 300, nullptr, Point2d{ 10, 0 }, Point2d{ 10, 10 }, NaN });
+	lines.push_back(LineDef{ 301, nullptr, Point2d{ 0, 2 }, Point2d{ 20, 2 }, NaN });
+	System s;
+	s.coalesce_window = 0.01;
+	BuildScene(&s, circles, lines);
+	int events = 0;
+	for (BodyID trigger : { 300, 301 }) {
+		s.SubscribeTrigger(trigger, [&events](const std::vector<TriggerEvent> &e) { events += int(e.size()); });
+	}
+	s.AddImpulseEvent(3, 100, Vec2d{ -2, 3 });
+	s.AddImpulseEvent(7.5, 4, Vec2d{ 1, -1 });
+	s.CalculateToTime(15);
+	return s.TimelineDigest() ^ std::uint64_t(events);
+}
+
+// Friction also solves quartics, whose resolvent cubic uses acos, cos and
+// pow. C runtimes needn't round those the same as each other, so this
+// digest is pinned per runtime (see RUNTIME_DIGEST); MSVC's isn't pinned
+// yet, so the scene fails there until it is.
+static std::uint64_t Friction() {
+	std::vector<CircleDef> circles;
+	std::vector<LineDef> lines;
+	Table(0.6, &circles, &lines);
+	System s;
+	BuildScene(&s, circles, lines);
+	s.CalculateToRest();
+	return s.TimelineDigest();
+}
+
+// RUNTIME_DIGEST picks the digest pinned for this build's C runtime, or
+// zero, which fails, for a runtime with none yet: pin it from the digest
+// printed by a build with that runtime.
+#if defined(__GLIBC__)
+#define RUNTIME_DIGEST(glibc, msvc) (glibc)
+#elif defined(_MSC_VER)
+#define RUNTIME_DIGEST(glibc, msvc) (msvc)
+#else
+#define RUNTIME_DIGEST(glibc, msvc) 0
+#endif
+
+struct Golden {
+	const char *name;
+	std::uint64_t (*run)();
+	std::uint64_t digest;  // Zero if not pinned for this build.
+};
+
+int main() {
+#if defined(_MSC_VER) && defined(_M_X64)
+	// The x64 CRT picks FMA code for its math functions by CPU at run time,
+	// so turn that off, as clients must, to get the same results everywhere.
+	_set_FMA3_enable(0);
+#endif
+	const Golden scenes[] = {
+#ifndef SHARPPHYSICS_FMA
+		{ "Frictionless", Frictionless, 0xa8f2950c4ded3424 },
+		{ "Triggers", Triggers, 0xd328ecfdcd875d47 },
+		{ "Friction", Friction, RUNTIME_DIGEST(0x487706338b1e547f, 0) },
+#else
+		// Fused multiply-adds round differently, so give different digests.
+		{ "Frictionless", Frictionless, 0x4e7cb8b84b3a2db6 },
+		{ "Triggers", Triggers, 0x05bfd56ad74f07be },
+		{ "Friction", Friction, RUNTIME_DIGEST(0x443463aac12db2b9, 0) },
+#endif
+	};
+	int failures = 0;
+	for (const auto &scene : scenes) {
+		std::uint64_t digest = scene.run();
+		const char *result = (scene.digest == 0) ? "NOT PINNED" : (digest == scene.digest) ? "ok" : "MISMATCH";
+		if (scene.digest == 0 || digest != scene.digest) failures++;
+		printf("%-14s %016" PRIx64 "  %s\n", scene.name, digest, result);
+	}
+	return failures ? 1 : 0;
+}
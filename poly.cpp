@@ -4,6 +4,7 @@
 
 #include <cmath>
 
+#include "Base.h"     // for its floating point contraction settings
 #include "poly.h"     // solution of cubic and quartic equation
 
 namespace SharpPhysics {
@@ -18,8 +19,8 @@ namespace SharpPhysics {
 		//         1 real root : x[0], x[1] � i*x[2], return 1
 		int SolveP3(double *x, double a, double b, double c) {	// solve cubic equation x^3 + a*x^2 + b*x + c
 			double a2 = a*a;
-			double q = (a2 - 3 * b) / 9;
-			double r = (a*(2 * a2 - 9 * b) + 27 * c) / 54;
+			double q = MulAdd(-3, b, a2) / 9;
+			double r = MulAdd(a, MulAdd(-9, b, 2 * a2), 27 * c) / 54;
 			double r2 = r*r;
 			double q3 = q*q*q;
 			double A, B;
@@ -29,9 +30,9 @@ namespace SharpPhysics {
 				if (t > 1) t = 1;
 				t = acos(t);
 				a /= 3; q = -2 * std::sqrt(q);
-				x[0] = q*std::cos(t / 3) - a;
-				x[1] = q*std::cos((t + TwoPi) / 3) - a;
-				x[2] = q*std::cos((t - TwoPi) / 3) - a;
+				x[0] = MulAdd(q, std::cos(t / 3), -a);
+				x[1] = MulAdd(q, std::cos((t + TwoPi) / 3), -a);
+				x[2] = MulAdd(q, std::cos((t - TwoPi) / 3), -a);
 				return(3);
 			}
 			else {
@@ -41,7 +42,7 @@ namespace SharpPhysics {
 
 				a /= 3;
 				x[0] = (A + B) - a;
-				x[1] = -0.5*(A + B) - a;
+				x[1] = MulAdd(-0.5, A + B, -a);
 				x[2] = 0.5*std::sqrt(3.)*(A - B);
 				if (std::fabs(x[2]) < eps) { x[2] = x[1]; return(2); }
 				return(1);
@@ -53,7 +54,7 @@ namespace SharpPhysics {
 		// a>=0!
 		void  CSqrt(double x, double y, double &a, double &b) // returns:  a+i*s = sqrt(x+i*y)
 		{
-			double r = std::sqrt(x*x + y*y);
+			double r = std::sqrt(MulAdd(x, x, y*y));
 			if (y == 0) {
 				r = std::sqrt(r);
 				if (x >= 0) { a = r; b = 0; }
@@ -68,7 +69,7 @@ namespace SharpPhysics {
 		//---------------------------------------------------------------------------
 		int   SolveP4Bi(double *x, double b, double d)	// solve equation x^4 + b*x^2 + d = 0
 		{
-			double D = b*b - 4 * d;
+			double D = MulAdd(b, b, -4 * d);
 			if (D >= 0)
 			{
 				double sD = std::sqrt(D);
@@ -129,7 +130,7 @@ namespace SharpPhysics {
 			//if( c==0 ) return SolveP4Bi(x,b,d); // After that, c!=0
 			if (std::fabs(c) < 1e-14*(std::fabs(b) + std::fabs(d))) return SolveP4Bi(x, b, d); // After that, c!=0
 
-			int res3 = SolveP3(x, 2 * b, b*b - 4 * d, -c*c);	// solve resolvent
+			int res3 = SolveP3(x, 2 * b, MulAdd(b, b, -4 * d), -c*c);	// solve resolvent
 			// by Viet theorem:  x1*x2*x3=-c*c not equals to 0, so x1!=0, x2!=0, x3!=0
 			if (res3 > 1)	// 3 real roots, 
 			{
@@ -201,9 +202,9 @@ namespace SharpPhysics {
 		//-----------------------------------------------------------------------------
 		double N4Step(double x, double a, double b, double c, double d)	// one Newton step for x^4 + a*x^3 + b*x^2 + c*x + d
 		{
-			double fxs = ((4 * x + 3 * a)*x + 2 * b)*x + c;	// f'(x)
+			double fxs = MulAdd(MulAdd(MulAdd(4, x, 3 * a), x, 2 * b), x, c);	// f'(x)
 			if (fxs == 0) return 1e99;
-			double fx = (((x + a)*x + b)*x + c)*x + d;	// f(x)
+			double fx = MulAdd(MulAdd(MulAdd(x + a, x, b), x, c), x, d);	// f(x)
 			return x - fx / fxs;
 		}
 
@@ -213,9 +214,9 @@ namespace SharpPhysics {
 		// return 0: two pair of complex roots: x[0]�i*x[1],  x[2]�i*x[3], 
 		int   SolveP4(double *x, double a, double b, double c, double d) {	// solve equation x^4 + a*x^3 + b*x^2 + c*x + d by Dekart-Euler method
 			// move to a=0:
-			double d1 = d + 0.25*a*(0.25*b*a - 3. / 64 * a*a*a - c);
-			double c1 = c + 0.5*a*(0.25*a*a - b);
-			double b1 = b - 0.375*a*a;
+			double d1 = MulAdd(0.25*a, MulAdd(-(3. / 64 * a*a), a, 0.25*b*a) - c, d);
+			double c1 = MulAdd(0.5*a, MulAdd(0.25*a, a, -b), c);
+			double b1 = MulAdd(-0.375*a, a, b);
 			int res = SolveP4De(x, b1, c1, d1);
 			if (res == 4) { x[0] -= a / 4; x[1] -= a / 4; x[2] -= a / 4; x[3] -= a / 4; }
 			else if (res == 2) { x[0] -= a / 4; x[1] -= a / 4; x[2] -= a / 4; }
@@ -234,7 +235,7 @@ namespace SharpPhysics {
 			return res;
 		}
 
-#define F5(t) (((((t+a)*t+b)*t+c)*t+d)*t+e)
+#define F5(t) MulAdd(MulAdd(MulAdd(MulAdd(t + a, t, b), t, c), t, d), t, e)
 		// return real root of x^5 + a*x^4 + b*x^3 + c*x^2 + d*x + e = 0
 		double SolveP5_1(double a, double b, double c, double d, double e)
 		{
@@ -281,7 +282,7 @@ namespace SharpPhysics {
 				if (std::fabs(f2) < eps) return x2;
 				if (f2 > 0) { x1 = x2; f1 = f2; }
 				else       { x0 = x2; f0 = f2; }
-				f2s = (((5 * x2 + 4 * a)*x2 + 3 * b)*x2 + 2 * c)*x2 + d;		// f'(x2)
+				f2s = MulAdd(MulAdd(MulAdd(MulAdd(5, x2, 4 * a), x2, 3 * b), x2, 2 * c), x2, d);		// f'(x2)
 				if (std::fabs(f2s) < eps) { x2 = 1e99; continue; }
 				dx = f2 / f2s;
 				x2 -= dx;
@@ -293,7 +294,7 @@ namespace SharpPhysics {
 		int   SolveP5(double *x, double a, double b, double c, double d, double e)
 		{
 			double r = x[0] = SolveP5_1(a, b, c, d, e);
-			double a1 = a + r, b1 = b + r*a1, c1 = c + r*b1, d1 = d + r*c1;
+			double a1 = a + r, b1 = MulAdd(r, a1, b), c1 = MulAdd(r, b1, c), d1 = MulAdd(r, c1, d);
 			return 1 + SolveP4(x + 1, a1, b1, c1, d1);
 		}
 
@@ -309,9 +310,9 @@ namespace SharpPhysics {
 			double w1 = f1*(x2 - x0);
 			double w2 = f2*(x0 - x1);
 			double a1 = w0 + w1 + w2;
-			double b1 = -w0*(x1 + x2) - w1*(x2 + x0) - w2*(x0 + x1);
-			double c1 = w0*x1*x2 + w1*x2*x0 + w2*x0*x1;
-			double Di = b1*b1 - 4 * a1*c1;	// must be>0!
+			double b1 = MulAdd(-w2, x0 + x1, MulAdd(-w1, x2 + x0, -w0*(x1 + x2)));
+			double c1 = MulAdd(w2*x0, x1, MulAdd(w1*x2, x0, w0*x1*x2));
+			double Di = MulAdd(b1, b1, -(4 * a1*c1));	// must be>0!
 			if (Di < 0) { r1 = r2 = 1e99; return 0; }
 			Di = sqrt(Di);
 			r1 = (-b1 + Di) / 2 / a1;